@@ -0,0 +1,311 @@
+// BDTChannel: configuration of the four tau decay channels
+// (input files, sample fractions, expected events, BDT variables, cuts and
+// options), shared by TMVAClassification.C and the other BDT macros.
+//
+//     1 = tau->1h, 2 = tau->mu, 3 = tau->3h, 4 = tau->e
+//
+
+#ifndef BDTChannel__def
+#define BDTChannel__def
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "TCut.h"
+#include "TFile.h"
+#include "TH1F.h"
+#include "TMD5.h"
+#include "TString.h"
+#include "TSystem.h"
+#include "TTree.h"
+
+#include "TMVA/DataLoader.h"
+
+// one input tree: where it is, which class it belongs to and its global weight
+struct BDTSample {
+   BDTSample( const TString& fileName, const TString& treeName, bool isSignal, double weight, float fraction = 0 )
+      : fFileName( fileName ), fTreeName( treeName ), fIsSignal( isSignal ), fWeight( weight ), fFraction( fraction ) {}
+
+   TString fFileName;
+   TString fTreeName;
+   bool    fIsSignal;
+   double  fWeight;   // multiplies OscillationP event by event
+   float   fFraction; // share of the class: fWeight = fFraction/h89_MINBIAS_TFD->Integral()
+};
+
+// one input variable of the BDT, as given to DataLoader::AddVariable
+struct BDTVariable {
+   const char* fExpression;
+   const char* fTitle;
+   const char* fUnit;
+   char        fType;
+};
+
+struct BDTChannel {
+   int     fChannel;
+   TString fLabel;             // 1h, mu, 3h, e
+
+   // signal = DIS + QE, background = charm (1) + had. reint. or LAS (2)
+   TString fFileSignalDIS;
+   TString fFileSignalQE;
+   TString fFileBackground1;
+   TString fFileBackground2;   // empty for tau->e
+   float   fTauDISFraction;
+   float   fCharmFraction;
+
+   // expected signal and background events (normalisation of the BDT plots)
+   float   fNExpSignal;
+   float   fNExpBackground;
+
+   std::vector<BDTVariable> fVariables;
+   std::vector<std::string> fExtraColumns; // branches read for the cuts and the plots only
+   TCut    fCutSignal;
+   TCut    fCutBackground;
+   TString fSplitOptions;      // PrepareTrainingAndTestTree
+   TString fBDTOptions;        // BookMethod( kBDT, "BDT", ... )
+
+   bool HasBackground2() const { return !fFileBackground2.IsNull(); }
+};
+
+//_______________________________________________________________________
+inline bool GetBDTChannel( int channel, BDTChannel& cfg )
+{
+   float nexp_S[5] = {0, 2.96, 1.15, 1.83, 0.84};
+   float nexp_B[5] = {0, 1.43, 0.024, 0.52, 0.035};
+   float charmfraction[5] = {0, 0.1080, 0.3192, 0.8344, 1};
+   float tauDISfraction[5] = {0, 0.9563, 0.9060, 0.8231, 0.9374};
+   //    float charmfraction[5]={0, 0.1080, 0.7419, 0.8344, 1};
+   //    float tauDISfraction[5]={0, 0.9563, 0.9090, 0.8231, 0.9374};
+   const char* label[5] = {"", "1h", "mu", "3h", "e"};
+
+   if (channel < 1 || channel > 4) {
+      std::cout << "Problem in GetBDTChannel: unknown channel " << channel
+                << " (1 = tau->1h, 2 = tau->mu, 3 = tau->3h, 4 = tau->e)" << std::endl;
+      return false;
+   }
+
+   cfg.fChannel        = channel;
+   cfg.fLabel          = label[channel];
+   cfg.fTauDISFraction = tauDISfraction[channel];
+   cfg.fCharmFraction  = charmfraction[channel];
+   cfg.fNExpSignal     = nexp_S[channel];
+   cfg.fNExpBackground = nexp_B[channel];
+
+   if (channel==1) {
+      cfg.fFileSignalDIS   = "./datarootfiles/bdt_kinematics_1_0_0.root";
+      cfg.fFileSignalQE    = "./datarootfiles/bdt_kinematics_1_1_0.root";
+      cfg.fFileBackground1 = "./datarootfiles/bdt_kinematics_5_0_0.root";
+      cfg.fFileBackground2 = "./datarootfiles/bdt_kinematics_21_0.root";
+   }
+   else if (channel==2) {
+      cfg.fFileSignalDIS   = "./datarootfiles/bdt_kinematics_2_0_0.root";
+      cfg.fFileSignalQE    = "./datarootfiles/bdt_kinematics_2_1_0.root";
+      cfg.fFileBackground1 = "./datarootfiles/bdt_kinematics_6_0_0.root";
+      cfg.fFileBackground2 = "./datarootfiles/bdt_kinematics_20_0_0.root";
+   }
+   else if (channel==3) {
+      cfg.fFileSignalDIS   = "./datarootfiles/bdt_kinematics_3_0_0.root";
+      cfg.fFileSignalQE    = "./datarootfiles/bdt_kinematics_3_1_0.root";
+      cfg.fFileBackground1 = "./datarootfiles/bdt_kinematics_7_0_0.root";
+      cfg.fFileBackground2 = "./datarootfiles/bdt_kinematics_22_0.root";
+   }
+   else {
+      cfg.fFileSignalDIS   = "./datarootfiles/bdt_kinematics_4_0_0.root";
+      cfg.fFileSignalQE    = "./datarootfiles/bdt_kinematics_4_1_0.root";
+      cfg.fFileBackground1 = "./datarootfiles/bdt_kinematics_8_0_0.root";
+      cfg.fFileBackground2 = "";
+   }
+
+   // input variables, in training order
+   cfg.fVariables.clear();
+   BDTVariable zdec  = { "zdec", "zdec", "#mum", 'F' };
+   BDTVariable kink  = { "kink", "kink", "rad", 'F' };
+   BDTVariable p2ry  = { "p2ry", "p2ry", "GeV/c", 'F' };
+   BDTVariable ptmiss = { "ptmiss", "ptmiss", "GeV/c", 'F' };
+   BDTVariable phi   = { "phi", "phi", "rad", 'F' };
+   BDTVariable gammadecvtx = { "gammadecvtx", "gammadecvtx", "GeV/c", 'I' };
+   BDTVariable charge2ry = { "charge2ry", "charge", "Charge", 'I' };
+   BDTVariable Minv  = { "Minv", "Minv", "GeV/c", 'F' };
+   BDTVariable pt2ry = { "pt2ry", "pt2ry", "GeV/c", 'F' };
+   cfg.fVariables.push_back( zdec );
+   //cfg.fVariables.push_back( decay_length );
+   cfg.fVariables.push_back( kink );
+   cfg.fVariables.push_back( p2ry );
+   if (channel==1) {
+      cfg.fVariables.push_back( ptmiss );
+      cfg.fVariables.push_back( phi );
+      cfg.fVariables.push_back( gammadecvtx );
+   }
+   if (channel==2) {
+      cfg.fVariables.push_back( charge2ry );
+   }
+   if (channel==3) {
+      cfg.fVariables.push_back( ptmiss );
+      cfg.fVariables.push_back( phi );
+      cfg.fVariables.push_back( Minv );
+      //cfg.fVariables.push_back( Minvmin );
+   }
+   if (channel!=3) {
+      cfg.fVariables.push_back( pt2ry );
+   }
+
+   // the branches of the cuts below, and the plot-only ones
+   cfg.fExtraColumns.clear();
+   cfg.fExtraColumns.push_back( "phi" );
+   cfg.fExtraColumns.push_back( "ptmiss" );
+   cfg.fExtraColumns.push_back( "p2ry" );
+   if (channel==3) cfg.fExtraColumns.push_back( "Minvmin" );
+
+   cfg.fCutSignal     = "phi!=-99&&ptmiss!=-99&&p2ry<100";//&&pt2ry>0.2"; //ptcut
+   cfg.fCutBackground = "phi!=-99&&ptmiss!=-99&&p2ry<100";//&&pt2ry>0.2"; //ptcut
+
+   if (channel==1) cfg.fSplitOptions = "nTrain_Signal=0:nTrain_Background=5400:nTest_Signal=0:nTest_Background=0:SplitMode=Random:NormMode=None:!V";
+   else if (channel==3) cfg.fSplitOptions = "nTrain_Signal=3000:nTrain_Background=5000:nTest_Signal=0:nTest_Background=0:SplitMode=Random:NormMode=None:!V";
+   else cfg.fSplitOptions = "nTrain_Signal=0:nTrain_Background=0:nTest_Signal=0:nTest_Background=0:SplitMode=Random:NormMode=None:!V";
+
+   // Adaptive Boost
+   //      "!H:!V:NTrees=850:MinNodeSize=2.5%:MaxDepth=3:BoostType=AdaBoost:AdaBoostBeta=0.5:UseBaggedBoost:BaggedSampleFraction=0.5:SeparationType=GiniIndex:nCuts=20"
+   if (channel==1) {
+      //"!H:!V:NTrees=350:MinNodeSize=10%:MaxDepth=3:BoostType=AdaBoost:AdaBoostBeta=0.5:UseBaggedBoost:BaggedSampleFraction=0.5:SeparationType=GiniIndex:nCuts=20" //NEW
+      cfg.fBDTOptions = "!H:!V:NTrees=314:MinNodeSize=10%:MaxDepth=3:BoostType=AdaBoost:AdaBoostBeta=0.5:UseBaggedBoost:BaggedSampleFraction=0.5:SeparationType=GiniIndex:nCuts=-1"; //MinNodeSize=2.5% fondo peerfetto 240 //OLD
+   }
+   else if (channel==2) {//400
+      cfg.fBDTOptions = "!H:!V:NTrees=400:MinNodeSize=5%:MaxDepth=2:BoostType=AdaBoost:AdaBoostBeta=0.5:UseBaggedBoost:BaggedSampleFraction=0.5:SeparationType=GiniIndex:nCuts=20";
+   }
+   else if (channel==3) {//200 0.101 0.009
+      cfg.fBDTOptions = "!H:!V:NTrees=321:MinNodeSize=5%:MaxDepth=2:BoostType=AdaBoost:AdaBoostBeta=0.5:UseBaggedBoost:BaggedSampleFraction=0.5:SeparationType=GiniIndex:nCuts=20"; //321 //324 0.001 0.115
+      //OLD "!H:!V:NTrees=350:MinNodeSize=5%:MaxDepth=3:BoostType=AdaBoost:AdaBoostBeta=0.5:UseBaggedBoost:BaggedSampleFraction=0.5:SeparationType=GiniIndex:nCuts=20"
+   }
+   else {
+      cfg.fBDTOptions = "!H:!V:NTrees=138:MinNodeSize=15%:MaxDepth=2:BoostType=AdaBoost:AdaBoostBeta=0.5:UseBaggedBoost:BaggedSampleFraction=0.5:SeparationType=GiniIndex:nCuts=20";
+   }
+
+   return true;
+}
+
+//_______________________________________________________________________
+// the spectators of every channel, in the order of AddBDTVariables
+inline std::vector<BDTVariable> GetBDTSpectators()
+{
+   BDTVariable enu          = { "enu", "Nu_Energy", "GeV", 'F' };
+   BDTVariable oscillationP = { "OscillationP", "OscillationP", "", 'F' };
+   BDTVariable channel      = { "channel", "channel", "", 'I' };
+   std::vector<BDTVariable> spectators;
+   spectators.push_back( enu );
+   spectators.push_back( oscillationP );
+   spectators.push_back( channel );
+   return spectators;
+}
+
+//_______________________________________________________________________
+// input variables and spectators of the channel
+inline void AddBDTVariables( const BDTChannel& cfg, TMVA::DataLoader* dataloader )
+{
+   for (size_t ivar = 0; ivar < cfg.fVariables.size(); ivar++) {
+      const BDTVariable& var = cfg.fVariables[ivar];
+      dataloader->AddVariable( var.fExpression, var.fTitle, var.fUnit, var.fType );
+   }
+   std::vector<BDTVariable> spectators = GetBDTSpectators();
+   for (size_t ispec = 0; ispec < spectators.size(); ispec++) {
+      const BDTVariable& spec = spectators[ispec];
+      dataloader->AddSpectator( spec.fExpression, spec.fTitle, spec.fUnit, spec.fType );
+   }
+}
+
+//_______________________________________________________________________
+// the trees of the channel with their fractions, weights not yet computed
+inline void GetBDTSampleList( const BDTChannel& cfg, std::vector<BDTSample>& samples )
+{
+   samples.clear();
+   const TString files[4] = { cfg.fFileSignalDIS, cfg.fFileSignalQE, cfg.fFileBackground1, cfg.fFileBackground2 };
+   const char*   trees[4] = { "tau_DIS", "tau_QE", "bkg", "bkg2" };
+   const float   fractions[4] = { cfg.fTauDISFraction, 1-cfg.fTauDISFraction, cfg.fCharmFraction, 1-cfg.fCharmFraction };
+
+   for (int i = 0; i < 4; i++)
+      if (!files[i].IsNull()) samples.push_back( BDTSample( files[i], trees[i], i < 2, 0, fractions[i] ) );
+}
+
+//_______________________________________________________________________
+// the weight of a sample: its fraction over the h89_MINBIAS_TFD integral of its file
+inline bool GetBDTSampleWeight( BDTSample& sample )
+{
+   TFile* input = TFile::Open( sample.fFileName );
+   TH1F*  h89_MINBIAS_TFD = input ? (TH1F*)input->Get( "h89_MINBIAS_TFD" ) : 0;
+   if (!h89_MINBIAS_TFD) {
+      std::cout << "Problem in GetBDTSamples: cannot read h89_MINBIAS_TFD from " << sample.fFileName << std::endl;
+      delete input;
+      return false;
+   }
+   sample.fWeight = sample.fFraction/h89_MINBIAS_TFD->Integral();
+   delete input;
+   return true;
+}
+
+//_______________________________________________________________________
+// the trees of the channel, weighted with the sample fraction over the
+// h89_MINBIAS_TFD integral of their file
+inline bool GetBDTSamples( const BDTChannel& cfg, std::vector<BDTSample>& samples )
+{
+   GetBDTSampleList( cfg, samples );
+   for (size_t is = 0; is < samples.size(); is++)
+      if (!GetBDTSampleWeight( samples[is] )) return false;
+   return true;
+}
+
+//_______________________________________________________________________
+// MD5 of the content of an input file, empty if it cannot be read; computed
+// once per process and file, again only if its size or time changes
+inline std::string GetBDTFileChecksum( const TString& fileName )
+{
+   struct Checksum {
+      Long64_t    fSize;
+      Long_t      fModTime;
+      std::string fMD5;
+   };
+   static std::map<std::string, Checksum> checksums;
+   FileStat_t stat;
+   if (gSystem->GetPathInfo( fileName, stat ) != 0) return "";
+   std::map<std::string, Checksum>::iterator it = checksums.find( fileName.Data() );
+   if (it != checksums.end() && it->second.fSize == stat.fSize && it->second.fModTime == stat.fMtime) return it->second.fMD5;
+
+   TMD5* md5 = TMD5::FileChecksum( fileName );
+   if (!md5) return "";
+   Checksum checksum = { stat.fSize, stat.fMtime, md5->AsString() };
+   delete md5;
+   checksums[fileName.Data()] = checksum;
+   return checksum.fMD5;
+}
+
+//_______________________________________________________________________
+// the trees of the samples; they stay owned by their (open) input files
+inline std::vector<TTree*> OpenBDTTrees( const std::vector<BDTSample>& samples )
+{
+   std::vector<TTree*> trees;
+   for (size_t is = 0; is < samples.size(); is++) {
+      TFile* input = TFile::Open( samples[is].fFileName );
+      TTree* tree  = input ? (TTree*)input->Get( samples[is].fTreeName ) : 0;
+      if (!tree) {
+         std::cout << "Problem in OpenBDTTrees: cannot read tree " << samples[is].fTreeName
+                   << " from " << samples[is].fFileName << std::endl;
+         delete input;
+         trees.clear();
+         return trees;
+      }
+      trees.push_back( tree );
+   }
+   return trees;
+}
+
+//_______________________________________________________________________
+// registers the trees of the samples in the dataloader, with their global weights
+inline void AddBDTTrees( TMVA::DataLoader* dataloader, const std::vector<BDTSample>& samples,
+                         const std::vector<TTree*>& trees, const TCut& cut = "",
+                         TMVA::Types::ETreeType treeType = TMVA::Types::kMaxTreeType )
+{
+   for (size_t is = 0; is < samples.size() && is < trees.size(); is++)
+      dataloader->AddTree( trees[is], samples[is].fIsSignal ? "Signal" : "Background", samples[is].fWeight, cut, treeType );
+}
+
+#endif
@@ -0,0 +1,437 @@
+// Class: BDTColumnCache
+// Column files of the input trees of a channel: every branch the channel
+// reads (variables, spectators, cut and plot branches, as float) and the final
+// event weight  Float_t(OscillationP)*sample weight,  one contiguous array per
+// column, memory-mapped read-only.
+//
+// A column file is named after the source file, tree and channel and keyed by
+// the MD5 of the source file content, the channel, the sample fraction and the
+// column list: it is rebuilt (and the stale one removed) only when one of them
+// changes; otherwise no ROOT file is opened nor decompressed. The source file
+// is hashed once per process (GetBDTFileChecksum), the key once per sample.
+//
+// usage:
+//
+//     BDTColumnCache cache( cfg );                     // ./cache
+//     std::vector<BDTSample> samples;
+//     cache.GetSamples( samples );                     // weights from the cache
+//     const BDTColumnFile* file = cache.Get( samples[0] );
+//     const float* zdec   = file->GetColumn( "zdec" );
+//     const float* weight = file->GetWeight();
+//     std::vector<TTree*> trees = cache.MakeTrees( samples ); // in-memory trees for a DataLoader
+//
+// file layout: header (magic, entries, columns, data offset, sample weight,
+// key, column names), then the columns and the weights, each nEntries floats
+// starting on a 64-byte boundary
+//
+
+#ifndef BDTColumnCache__def
+#define BDTColumnCache__def
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TFile.h"
+#include "TMD5.h"
+#include "TString.h"
+#include "TSystem.h"
+#include "TTree.h"
+
+#include "BDTChannel.h"
+#include "BDTTreeReader.h"
+
+class BDTColumnFile {
+
+ public:
+
+   // maps the column file "path" read-only; IsStatusClean() is false if it
+   // is missing, truncated or not a column file
+   BDTColumnFile( const std::string& path )
+      : fClassName( "BDTColumnFile" ), fStatusIsClean( false ), fPath( path ),
+        fMap( 0 ), fSize( 0 ), fEntries( 0 ), fSampleWeight( 0 ), fWeights( 0 )
+   {
+      fStatusIsClean = Map();
+   }
+   ~BDTColumnFile() { if (fMap) munmap( fMap, fSize ); }
+   BDTColumnFile( const BDTColumnFile& ) = delete;
+   BDTColumnFile& operator=( const BDTColumnFile& ) = delete;
+
+   bool IsStatusClean() const { return fStatusIsClean; }
+   const std::string& GetPath() const { return fPath; }
+   const std::string& GetKey() const { return fKey; }
+
+   Long64_t GetEntries()      const { return fEntries; }
+   double   GetSampleWeight() const { return fSampleWeight; }
+   const std::vector<std::string>& GetColumnNames() const { return fNames; }
+
+   // the column of branch "name" (fEntries floats), 0 if it is not in the file
+   const float* GetColumn( const std::string& name ) const {
+      for (size_t i = 0; i < fNames.size(); i++)
+         if (fNames[i] == name) return fColumns[i];
+      return 0;
+   }
+   // Float_t(OscillationP)*sample weight, event by event
+   const float* GetWeight() const { return fWeights; }
+
+   // a memory-resident TTree with one Float_t branch per column, for the
+   // TMVA DataLoader (which only reads trees); owned by the caller
+   TTree* MakeTree( const char* name = "columns" ) const;
+
+   // writes a column file atomically (temporary file + rename)
+   static bool Write( const std::string& path, const std::string& key, double sampleWeight,
+                      const std::vector<std::string>& names, const std::vector< std::vector<float> >& columns,
+                      const std::vector<float>& weights );
+
+ private:
+
+   static const char*    Magic() { return "BDTCOL1"; } // 8 bytes with the '\0'
+   static const uint64_t kAlign = 64;
+
+   static uint64_t Align( uint64_t n ) { return (n + kAlign - 1)/kAlign*kAlign; }
+
+   bool Map();
+   bool Problem( const std::string& what ) const {
+      std::cout << "Problem in class \"" << fClassName << "\": " << what << std::endl;
+      return false;
+   }
+
+   const char*  fClassName;
+   bool         fStatusIsClean;
+   std::string  fPath;
+   void*        fMap;
+   size_t       fSize;
+
+   Long64_t                  fEntries;
+   double                    fSampleWeight;
+   std::string               fKey;
+   std::vector<std::string>  fNames;
+   std::vector<const float*> fColumns;
+   const float*              fWeights;
+};
+
+class BDTColumnCache {
+
+ public:
+
+   // the column files of channel "cfg" in directory "dir"
+   BDTColumnCache( const BDTChannel& cfg, const std::string& dir = "cache" );
+   ~BDTColumnCache() { for (size_t it = 0; it < fTrees.size(); it++) delete fTrees[it]; }
+   BDTColumnCache( const BDTColumnCache& ) = delete;
+   BDTColumnCache& operator=( const BDTColumnCache& ) = delete;
+
+   // an extra branch to keep besides the ones of the channel; an optional one
+   // is set to defaultValue in the trees that do not have it
+   void AddColumn( const char* name, bool optional = false, float defaultValue = 0 );
+
+   // the samples of the channel with their weights, building the missing
+   // column files; returns false if a source file cannot be read
+   bool GetSamples( std::vector<BDTSample>& samples );
+
+   // the column file of "sample", built from its tree if missing or stale;
+   // 0 on failure. Owned by the cache, mapped until it is destroyed
+   const BDTColumnFile* Get( const BDTSample& sample );
+
+   // memory-resident trees of the samples, in order (see BDTColumnFile::MakeTree);
+   // owned by the cache, which must outlive the DataLoaders reading them
+   std::vector<TTree*> MakeTrees( const std::vector<BDTSample>& samples );
+
+ private:
+
+   std::string GetKey( const BDTSample& sample ) const;
+   std::string GetPrefix( const BDTSample& sample ) const;
+   bool Build( const BDTSample& sample, const std::string& path, const std::string& key );
+   void RemoveStale( const std::string& prefix, const std::string& path ) const;
+
+   BDTChannel                fConfig;
+   int                       fChannel;
+   std::string               fDir;
+   std::vector<std::string>  fColumns;
+   std::vector<bool>         fOptional;
+   std::vector<float>        fDefault;
+   std::map< std::string, std::shared_ptr<BDTColumnFile> > fFiles; // by path
+   std::map< std::string, std::string > fPaths;                     // by sample
+   std::vector<TTree*>       fTrees;
+};
+
+//_______________________________________________________________________
+inline bool BDTColumnFile::Map()
+{
+   int fd = open( fPath.c_str(), O_RDONLY );
+   if (fd < 0) return false;
+   struct stat st;
+   if (fstat( fd, &st ) != 0 || st.st_size < 64) { close( fd ); return false; }
+   fSize = st.st_size;
+   void* map = mmap( 0, fSize, PROT_READ, MAP_SHARED, fd, 0 );
+   close( fd );
+   if (map == MAP_FAILED) return false;
+   fMap = map;
+
+   // header: magic, entries, columns, data offset, sample weight, key length, key, names
+   const char* p   = (const char*)fMap;
+   const char* end = p + fSize;
+   if (std::memcmp( p, Magic(), 8 ) != 0) return Problem( fPath + " is not a column file" );
+   p += 8;
+   uint64_t entries, ncol, offset, keyLength;
+   double   weight;
+   std::memcpy( &entries, p, 8 ); p += 8;
+   std::memcpy( &ncol, p, 8 );    p += 8;
+   std::memcpy( &offset, p, 8 );  p += 8;
+   std::memcpy( &weight, p, 8 );  p += 8;
+   std::memcpy( &keyLength, p, 8 ); p += 8;
+   if (keyLength > uint64_t(end - p)) return Problem( fPath + " is truncated" );
+   fKey.assign( p, keyLength ); p += keyLength;
+   for (uint64_t ic = 0; ic < ncol; ic++) {
+      const char* name = p;
+      while (p < end && *p) p++;
+      if (p == end) return Problem( fPath + " is truncated" );
+      fNames.push_back( std::string( name, p ) );
+      p++;
+   }
+
+   const uint64_t stride = Align( entries*sizeof(float) );
+   if (offset % kAlign != 0 || offset + (ncol + 1)*stride > fSize) return Problem( fPath + " is truncated" );
+   fEntries      = entries;
+   fSampleWeight = weight;
+   for (uint64_t ic = 0; ic < ncol; ic++)
+      fColumns.push_back( (const float*)((const char*)fMap + offset + ic*stride) );
+   fWeights = (const float*)((const char*)fMap + offset + ncol*stride);
+   return true;
+}
+
+//_______________________________________________________________________
+inline bool BDTColumnFile::Write( const std::string& path, const std::string& key, double sampleWeight,
+                                  const std::vector<std::string>& names, const std::vector< std::vector<float> >& columns,
+                                  const std::vector<float>& weights )
+{
+   std::string header( Magic(), 8 );
+   uint64_t entries = weights.size(), ncol = names.size(), keyLength = key.size();
+   std::string names0;
+   for (size_t ic = 0; ic < names.size(); ic++) names0 += names[ic] + '\0';
+   uint64_t offset = Align( header.size() + 5*8 + keyLength + names0.size() );
+   header.append( (const char*)&entries, 8 );
+   header.append( (const char*)&ncol, 8 );
+   header.append( (const char*)&offset, 8 );
+   header.append( (const char*)&sampleWeight, 8 );
+   header.append( (const char*)&keyLength, 8 );
+   header += key + names0;
+   header.resize( offset, '\0' );
+
+   const uint64_t stride = Align( entries*sizeof(float) );
+   const std::string padding( stride - entries*sizeof(float), '\0' );
+   std::string tmp = path + ".tmp." + std::to_string( getpid() );
+   FILE* out = std::fopen( tmp.c_str(), "wb" );
+   if (!out) {
+      std::cout << "Problem in class \"BDTColumnFile\": cannot write " << tmp << std::endl;
+      return false;
+   }
+   bool ok = std::fwrite( header.data(), 1, header.size(), out ) == header.size();
+   for (size_t ic = 0; ic <= ncol && ok; ic++) {
+      const std::vector<float>& column = (ic < ncol) ? columns[ic] : weights;
+      ok = std::fwrite( column.data(), sizeof(float), entries, out ) == entries &&
+           std::fwrite( padding.data(), 1, padding.size(), out ) == padding.size();
+   }
+   ok = (std::fclose( out ) == 0) && ok;
+   if (!ok || std::rename( tmp.c_str(), path.c_str() ) != 0) {
+      std::remove( tmp.c_str() );
+      std::cout << "Problem in class \"BDTColumnFile\": cannot write " << path << std::endl;
+      return false;
+   }
+   return true;
+}
+
+//_______________________________________________________________________
+inline TTree* BDTColumnFile::MakeTree( const char* name ) const
+{
+   TTree* tree = new TTree( name, fPath.c_str() );
+   tree->SetDirectory( 0 );
+   std::vector<Float_t> buffer( fNames.size() );
+   for (size_t ic = 0; ic < fNames.size(); ic++)
+      tree->Branch( fNames[ic].c_str(), &buffer[ic], (fNames[ic] + "/F").c_str() );
+   for (Long64_t j = 0; j < fEntries; j++) {
+      for (size_t ic = 0; ic < fNames.size(); ic++) buffer[ic] = fColumns[ic][j];
+      tree->Fill();
+   }
+   tree->ResetBranchAddresses();
+   return tree;
+}
+
+//_______________________________________________________________________
+inline BDTColumnCache::BDTColumnCache( const BDTChannel& cfg, const std::string& dir )
+   : fConfig( cfg ), fChannel( cfg.fChannel ), fDir( dir )
+{
+   for (size_t ivar = 0; ivar < cfg.fVariables.size(); ivar++) AddColumn( cfg.fVariables[ivar].fExpression );
+   AddColumn( "enu" );
+   AddColumn( "OscillationP" );
+   AddColumn( "channel", true, 0 ); //only in the bkg trees
+   for (size_t ic = 0; ic < cfg.fExtraColumns.size(); ic++) AddColumn( cfg.fExtraColumns[ic].c_str() );
+}
+
+//_______________________________________________________________________
+inline void BDTColumnCache::AddColumn( const char* name, bool optional, float defaultValue )
+{
+   if (std::find( fColumns.begin(), fColumns.end(), std::string(name) ) != fColumns.end()) return;
+   fPaths.clear(); // the keys change
+   fColumns.push_back( name );
+   fOptional.push_back( optional );
+   fDefault.push_back( defaultValue );
+}
+
+//_______________________________________________________________________
+inline std::string BDTColumnCache::GetPrefix( const BDTSample& sample ) const
+{
+   TString base = gSystem->BaseName( sample.fFileName );
+   if (base.EndsWith( ".root" )) base.Resize( base.Length() - 5 );
+   return fDir + "/" + base.Data() + "_" + sample.fTreeName.Data() + "_ch" + std::to_string( fChannel ) + "_";
+}
+
+//_______________________________________________________________________
+inline std::string BDTColumnCache::GetKey( const BDTSample& sample ) const
+{
+   std::string checksum = GetBDTFileChecksum( sample.fFileName );
+   if (checksum.empty()) return "";
+   std::string key = checksum + " ch" + std::to_string( fChannel ) + " " +
+                     sample.fTreeName.Data() + " " + TString::Format( "%.9g", sample.fFraction ).Data();
+   for (size_t ic = 0; ic < fColumns.size(); ic++)
+      key += " " + fColumns[ic] + (fOptional[ic] ? TString::Format( "?%g", fDefault[ic] ).Data() : "");
+   return key;
+}
+
+//_______________________________________________________________________
+inline const BDTColumnFile* BDTColumnCache::Get( const BDTSample& sample )
+{
+   // a sample already mapped by this cache
+   const std::string id = std::string( sample.fFileName.Data() ) + ":" + sample.fTreeName.Data() + ":" +
+                          TString::Format( "%.9g", sample.fFraction ).Data();
+   std::map< std::string, std::string >::const_iterator ip = fPaths.find( id );
+   if (ip != fPaths.end()) return fFiles[ip->second].get();
+
+   std::string key = GetKey( sample );
+   if (key.empty()) {
+      std::cout << "Problem in class \"BDTColumnCache\": cannot read " << sample.fFileName << std::endl;
+      return 0;
+   }
+   TMD5 md5;
+   md5.Update( (const UChar_t*)key.data(), key.size() );
+   md5.Final();
+   std::string prefix = GetPrefix( sample );
+   std::string path   = prefix + std::string( md5.AsString() ).substr( 0, 16 ) + ".col";
+
+   std::map< std::string, std::shared_ptr<BDTColumnFile> >::iterator it = fFiles.find( path );
+   if (it != fFiles.end()) {
+      fPaths[id] = path;
+      return it->second.get();
+   }
+
+   std::shared_ptr<BDTColumnFile> file( new BDTColumnFile( path ) );
+   if (!file->IsStatusClean() || file->GetKey() != key) {
+      if (!Build( sample, path, key )) return 0;
+      RemoveStale( prefix, path );
+      file.reset( new BDTColumnFile( path ) );
+      if (!file->IsStatusClean() || file->GetKey() != key) return 0;
+   }
+   fFiles[path] = file;
+   fPaths[id] = path;
+   return file.get();
+}
+
+//_______________________________________________________________________
+inline bool BDTColumnCache::Build( const BDTSample& sample, const std::string& path, const std::string& key )
+{
+   std::cout << "BDTColumnCache: building " << path << " from " << sample.fFileName << ":" << sample.fTreeName << std::endl;
+   BDTSample weighted = sample;
+   if (!GetBDTSampleWeight( weighted )) return false;
+
+   TFile* input = TFile::Open( sample.fFileName );
+   TTree* tree  = input ? (TTree*)input->Get( sample.fTreeName ) : 0;
+   if (!tree) {
+      std::cout << "Problem in class \"BDTColumnCache\": cannot read tree " << sample.fTreeName
+                << " from " << sample.fFileName << std::endl;
+      delete input;
+      return false;
+   }
+
+   BDTTreeReader reader( tree, fColumns, fOptional, fDefault );
+   if (!reader.IsStatusClean()) {
+      delete input;
+      return false;
+   }
+
+   const size_t   ncol    = fColumns.size();
+   const Long64_t entries = reader.GetEntries();
+   const size_t   iOsc    = std::find( fColumns.begin(), fColumns.end(), std::string("OscillationP") ) - fColumns.begin();
+   std::vector< std::vector<float> > columns( ncol, std::vector<float>( entries ) );
+   std::vector<float*> buffers( ncol );
+   for (size_t ic = 0; ic < ncol; ic++) buffers[ic] = columns[ic].data();
+   reader.Read( 0, entries, buffers.data() );
+   std::vector<float> weights( entries );
+   for (Long64_t j = 0; j < entries; j++) {
+      Float_t weight = columns[iOsc][j];
+      weight *= weighted.fWeight;
+      weights[j] = weight;
+   }
+   delete input;
+
+   gSystem->mkdir( fDir.c_str(), true );
+   return BDTColumnFile::Write( path, key, weighted.fWeight, fColumns, columns, weights );
+}
+
+//_______________________________________________________________________
+inline void BDTColumnCache::RemoveStale( const std::string& prefix, const std::string& path ) const
+{
+   // column files of the same source, tree and channel with another key
+   void* dir = gSystem->OpenDirectory( fDir.c_str() );
+   if (!dir) return;
+   std::vector<std::string> stale;
+   const std::string base = prefix.substr( fDir.size() + 1 );
+   while (const char* entry = gSystem->GetDirEntry( dir )) {
+      std::string name = fDir + "/" + entry;
+      if (name != path && std::string( entry ).compare( 0, base.size(), base ) == 0 &&
+          TString( entry ).EndsWith( ".col" ) && name.size() == path.size())
+         stale.push_back( name );
+   }
+   gSystem->FreeDirectory( dir );
+   for (size_t i = 0; i < stale.size(); i++) gSystem->Unlink( stale[i].c_str() );
+}
+
+//_______________________________________________________________________
+inline bool BDTColumnCache::GetSamples( std::vector<BDTSample>& samples )
+{
+   GetBDTSampleList( fConfig, samples );
+   for (size_t is = 0; is < samples.size(); is++) {
+      const BDTColumnFile* file = Get( samples[is] );
+      if (!file) return false;
+      samples[is].fWeight = file->GetSampleWeight();
+   }
+   return true;
+}
+
+//_______________________________________________________________________
+inline std::vector<TTree*> BDTColumnCache::MakeTrees( const std::vector<BDTSample>& samples )
+{
+   std::vector<TTree*> trees;
+   for (size_t is = 0; is < samples.size(); is++) {
+      const BDTColumnFile* file = Get( samples[is] );
+      if (!file) {
+         for (size_t it = 0; it < trees.size(); it++) delete trees[it];
+         trees.clear();
+         return trees;
+      }
+      trees.push_back( file->MakeTree( samples[is].fTreeName ) );
+   }
+   fTrees.insert( fTrees.end(), trees.begin(), trees.end() );
+   return trees;
+}
+
+#endif
@@ -0,0 +1,344 @@
+// Class: BDTCutOptimizer
+// Unbinned choice of the cut on the BDT response, on the list of
+// (response, weight, class) of the events.
+//
+// The events are sorted once; every distinct response value is a cut
+// (response >= cut is selected) and the signal and background weights above
+// it are exact cumulative sums. For every cut it gives the signal efficiency,
+// the background efficiency, the purity, efficiency*purity, s/sqrt(b) and
+// s/sqrt(s+b), with s and b normalised to the expected events as the h_bdt
+// histograms of TMVAClassification.C.
+//
+// The errors come from a Poisson bootstrap: every replica reweights each
+// event by k ~ Poisson(1) and redoes the cumulative sums in the same sorted
+// order (no sorting, no binning), so thousands of replicas are cheap; they
+// are spread over threads, replica r always using seed+r, and summed in
+// replica order: the errors do not depend on the number of workers. The
+// replicas run in chunks holding at most kBootstrapMemory bytes of figures.
+//
+// usage:
+//
+//     BDTCutOptimizer optimizer( nexp_S, nexp_B );
+//     optimizer.AddEvent( bdt, weight, isSignal );        // for every event
+//     optimizer.Optimize();
+//     optimizer.Bootstrap( 1000 );                        // optional: errors
+//     size_t best = optimizer.GetBest();                  // max efficiency*purity
+//     double cut  = optimizer.GetCut( best );
+//     TGraphErrors* gr = optimizer.MakeGraph( BDTCutOptimizer::kPurity );
+//
+
+#ifndef BDTCutOptimizer__def
+#define BDTCutOptimizer__def
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "TGraphErrors.h"
+
+class BDTCutOptimizer {
+
+ public:
+
+   enum EFigure {
+      kEfficiency = 0,        // signal efficiency
+      kBackgroundEfficiency,
+      kPurity,                // s/(s+b)
+      kEfficiencyPurity,
+      kSignificance,          // s/sqrt(b)
+      kSignalOverSqrtSB,      // s/sqrt(s+b)
+      kNFigures
+   };
+
+   // nExpSignal, nExpBackground: the expected events s and b are normalised to
+   // (0: the sums of the weights)
+   BDTCutOptimizer( double nExpSignal = 0, double nExpBackground = 0 )
+      : fNExpSignal( nExpSignal ), fNExpBackground( nExpBackground ),
+        fNReplicas( 0 ), fBootstrapFigure( kEfficiencyPurity ) {}
+
+   void AddEvent( double response, double weight, bool isSignal ) {
+      Event event = { response, weight, isSignal };
+      fEvents.push_back( event );
+   }
+   size_t GetNEvents() const { return fEvents.size(); }
+
+   // sorts the events and computes every figure at every cut;
+   // returns false without signal or background
+   bool Optimize();
+
+   // the cuts, ascending
+   size_t GetNCuts() const { return fCuts.size(); }
+   double GetCut( size_t icut ) const { return fCuts[icut]; }
+   double GetValue( EFigure figure, size_t icut ) const { return fValues[figure][icut]; }
+   // bootstrap standard deviation (0 before Bootstrap)
+   double GetError( EFigure figure, size_t icut ) const;
+
+   // the cut with the largest figure (the highest one on ties)
+   size_t GetBest( EFigure figure = kEfficiencyPurity ) const;
+
+   // area under the background rejection vs signal efficiency curve
+   double GetROCIntegral() const;
+
+   // nReplicas Poisson bootstrap replicas on nWorkers threads (0: all the cores);
+   // also records the best cut of "figure" in every replica
+   void Bootstrap( int nReplicas, int nWorkers = 0, EFigure figure = kEfficiencyPurity, unsigned int seed = 4357 );
+   int GetNReplicas() const { return fNReplicas; }
+
+   // spread of the best cut over the replicas: standard deviation, and the
+   // central interval containing a fraction cl of them
+   double GetBestCutError() const;
+   void   GetBestCutInterval( double& low, double& high, double cl = 0.6827 ) const;
+
+   // the figure vs the cut, with the bootstrap errors, at the cuts next to
+   // nPoints evenly spaced values (plus the best cut of the figure); all the
+   // cuts for nPoints <= 0. The optimum is always the one of the full scan
+   TGraphErrors* MakeGraph( EFigure figure, int nPoints = 200 ) const;
+
+ private:
+
+   static const size_t kBootstrapMemory = 256 << 20; // figures of the replicas in flight, bytes
+
+   struct Event {
+      double fResponse;
+      double fWeight;
+      bool   fIsSignal;
+   };
+
+   // the figures at every cut from the signal and background weights of every group
+   // of events with the same response
+   void Compute( const std::vector<double>& sigWeights, const std::vector<double>& bkgWeights,
+                 std::vector<double>* values ) const;
+
+   double fNExpSignal;
+   double fNExpBackground;
+
+   std::vector<Event>  fEvents;       // sorted by Optimize
+   std::vector<size_t> fGroup;        // the cut of each sorted event
+   std::vector<double> fCuts;
+   std::vector<double> fValues[kNFigures];
+
+   int                 fNReplicas;
+   EFigure             fBootstrapFigure;
+   std::vector<double> fErrors[kNFigures];
+   std::vector<double> fBestCuts;     // one per replica
+};
+
+//_______________________________________________________________________
+inline bool BDTCutOptimizer::Optimize()
+{
+   std::sort( fEvents.begin(), fEvents.end(),
+              []( const Event& a, const Event& b ) { return a.fResponse < b.fResponse; } );
+   fCuts.clear();
+   fGroup.assign( fEvents.size(), 0 );
+   for (size_t i = 0; i < fEvents.size(); i++) {
+      if (fCuts.empty() || fEvents[i].fResponse != fCuts.back()) fCuts.push_back( fEvents[i].fResponse );
+      fGroup[i] = fCuts.size() - 1;
+   }
+
+   std::vector<double> sigWeights( fCuts.size(), 0 ), bkgWeights( fCuts.size(), 0 );
+   for (size_t i = 0; i < fEvents.size(); i++)
+      (fEvents[i].fIsSignal ? sigWeights : bkgWeights)[fGroup[i]] += fEvents[i].fWeight;
+   Compute( sigWeights, bkgWeights, fValues );
+
+   fNReplicas = 0;
+   fBestCuts.clear();
+   for (int f = 0; f < kNFigures; f++) fErrors[f].assign( fCuts.size(), 0 );
+
+   if (fCuts.empty() || fValues[kEfficiency][0] <= 0 || fValues[kBackgroundEfficiency][0] <= 0) {
+      std::cout << "Problem in class \"BDTCutOptimizer\": no signal or no background events" << std::endl;
+      return false;
+   }
+   return true;
+}
+
+//_______________________________________________________________________
+inline void BDTCutOptimizer::Compute( const std::vector<double>& sigWeights, const std::vector<double>& bkgWeights,
+                                      std::vector<double>* values ) const
+{
+   const size_t ncut = sigWeights.size();
+   for (int f = 0; f < kNFigures; f++) values[f].assign( ncut, 0 );
+
+   // cumulative from the top: weights with response >= cut
+   double S = 0, B = 0;
+   std::vector<double> above( 2*ncut );
+   for (size_t k = ncut; k-- > 0; ) {
+      S += sigWeights[k];
+      B += bkgWeights[k];
+      above[2*k]     = S;
+      above[2*k + 1] = B;
+   }
+   if (S <= 0 && B <= 0) return;
+   const double normS = (fNExpSignal > 0 && S > 0) ? fNExpSignal/S : 1;
+   const double normB = (fNExpBackground > 0 && B > 0) ? fNExpBackground/B : 1;
+
+   for (size_t k = 0; k < ncut; k++) {
+      const double s = above[2*k]*normS, b = above[2*k + 1]*normB;
+      values[kEfficiency][k]           = S > 0 ? above[2*k]/S : 0;
+      values[kBackgroundEfficiency][k] = B > 0 ? above[2*k + 1]/B : 0;
+      values[kPurity][k]               = (s + b > 0) ? s/(s + b) : 0;
+      values[kEfficiencyPurity][k]     = values[kEfficiency][k]*values[kPurity][k];
+      values[kSignificance][k]         = b > 0 ? s/std::sqrt( b ) : 0;
+      values[kSignalOverSqrtSB][k]     = (s + b > 0) ? s/std::sqrt( s + b ) : 0;
+   }
+}
+
+//_______________________________________________________________________
+inline double BDTCutOptimizer::GetError( EFigure figure, size_t icut ) const
+{
+   return icut < fErrors[figure].size() ? fErrors[figure][icut] : 0;
+}
+
+//_______________________________________________________________________
+inline size_t BDTCutOptimizer::GetBest( EFigure figure ) const
+{
+   size_t best = 0;
+   for (size_t k = 0; k < fCuts.size(); k++)
+      if (fValues[figure][k] >= fValues[figure][best]) best = k;
+   return best;
+}
+
+//_______________________________________________________________________
+inline double BDTCutOptimizer::GetROCIntegral() const
+{
+   // trapezoids between consecutive cuts, from the loosest one (efficiency 1)
+   double roc = 0;
+   const std::vector<double>& effS = fValues[kEfficiency];
+   const std::vector<double>& effB = fValues[kBackgroundEfficiency];
+   for (size_t k = 0; k < fCuts.size(); k++) {
+      double nextS = (k + 1 < fCuts.size()) ? effS[k + 1] : 0;
+      double nextB = (k + 1 < fCuts.size()) ? effB[k + 1] : 0;
+      roc += (effS[k] - nextS) * (1 - 0.5*(effB[k] + nextB));
+   }
+   return roc;
+}
+
+//_______________________________________________________________________
+inline void BDTCutOptimizer::Bootstrap( int nReplicas, int nWorkers, EFigure figure, unsigned int seed )
+{
+   const size_t ncut = fCuts.size();
+   fNReplicas       = std::max( 0, nReplicas );
+   fBootstrapFigure = figure;
+   fBestCuts.assign( fNReplicas, 0 );
+   for (int f = 0; f < kNFigures; f++) fErrors[f].assign( ncut, 0 );
+   if (fNReplicas == 0 || ncut == 0) return;
+
+   if (nWorkers <= 0) nWorkers = std::max( 1u, std::thread::hardware_concurrency() );
+
+   // the figures of a chunk of replicas, one slot of kNFigures vectors per replica
+   const size_t slotSize = kNFigures*ncut*sizeof(double);
+   const int nSlots = std::max( 1, std::min( fNReplicas, int( kBootstrapMemory/slotSize ) ) );
+   std::vector< std::vector<double> > slots( nSlots*kNFigures );
+   // sum and sum of squares of every figure at every cut, over the replicas in order
+   std::vector<double> sum( kNFigures*ncut, 0 ), sum2( kNFigures*ncut, 0 );
+
+   auto parallel = [nWorkers]( int ntasks, const std::function<void( int )>& task ) {
+      std::atomic<int> next( 0 );
+      auto worker = [&]() { for (int i = next++; i < ntasks; i = next++) task( i ); };
+      std::vector<std::thread> workers;
+      for (int iw = 1; iw < std::min( nWorkers, ntasks ); iw++) workers.push_back( std::thread( worker ) );
+      worker();
+      for (size_t iw = 0; iw < workers.size(); iw++) workers[iw].join();
+   };
+
+   const int nBlocks = std::min<size_t>( ncut, 4*nWorkers );
+   for (int first = 0; first < fNReplicas; first += nSlots) {
+      const int nChunk = std::min( nSlots, fNReplicas - first );
+      parallel( nChunk, [&]( int islot ) {
+         const int r = first + islot;
+         std::vector<double>* values = &slots[islot*kNFigures];
+         std::vector<double> sigWeights( ncut, 0 ), bkgWeights( ncut, 0 );
+         std::mt19937 random( seed + r );
+         std::poisson_distribution<int> poisson( 1.0 );
+         for (size_t i = 0; i < fEvents.size(); i++) {
+            int k = poisson( random );
+            if (k) (fEvents[i].fIsSignal ? sigWeights : bkgWeights)[fGroup[i]] += k*fEvents[i].fWeight;
+         }
+         Compute( sigWeights, bkgWeights, values );
+         size_t best = 0;
+         for (size_t k = 0; k < ncut; k++)
+            if (values[figure][k] >= values[figure][best]) best = k;
+         fBestCuts[r] = fCuts[best];
+      } );
+      // every cut summed over the slots in replica order, the cuts split in blocks
+      parallel( nBlocks, [&]( int iblock ) {
+         const size_t begin = ncut*iblock/nBlocks, end = ncut*(iblock + 1)/nBlocks;
+         for (int f = 0; f < kNFigures; f++) {
+            double* s  = sum.data() + f*ncut;
+            double* s2 = sum2.data() + f*ncut;
+            for (int islot = 0; islot < nChunk; islot++) {
+               const double* v = slots[islot*kNFigures + f].data();
+               for (size_t k = begin; k < end; k++) {
+                  s[k]  += v[k];
+                  s2[k] += v[k]*v[k];
+               }
+            }
+         }
+      } );
+   }
+
+   for (int f = 0; f < kNFigures; f++) {
+      for (size_t k = 0; k < ncut; k++) {
+         double mean = sum[f*ncut + k]/fNReplicas;
+         fErrors[f][k] = std::sqrt( std::max( 0., sum2[f*ncut + k]/fNReplicas - mean*mean ) );
+      }
+   }
+}
+
+//_______________________________________________________________________
+inline double BDTCutOptimizer::GetBestCutError() const
+{
+   if (fBestCuts.empty()) return 0;
+   double s = 0, s2 = 0;
+   for (size_t r = 0; r < fBestCuts.size(); r++) {
+      s  += fBestCuts[r];
+      s2 += fBestCuts[r]*fBestCuts[r];
+   }
+   double mean = s/fBestCuts.size();
+   return std::sqrt( std::max( 0., s2/fBestCuts.size() - mean*mean ) );
+}
+
+//_______________________________________________________________________
+inline void BDTCutOptimizer::GetBestCutInterval( double& low, double& high, double cl ) const
+{
+   low = high = fCuts.empty() ? 0 : fCuts[GetBest( fBootstrapFigure )];
+   if (fBestCuts.empty()) return;
+   std::vector<double> cuts = fBestCuts;
+   std::sort( cuts.begin(), cuts.end() );
+   const size_t n = cuts.size();
+   low  = cuts[std::min( n - 1, size_t( 0.5*(1 - cl)*n ) )];
+   high = cuts[std::min( n - 1, size_t( 0.5*(1 + cl)*n ) )];
+}
+
+//_______________________________________________________________________
+inline TGraphErrors* BDTCutOptimizer::MakeGraph( EFigure figure, int nPoints ) const
+{
+   std::vector<size_t> points;
+   if (nPoints <= 0 || size_t( nPoints ) >= fCuts.size()) {
+      for (size_t k = 0; k < fCuts.size(); k++) points.push_back( k );
+   }
+   else {
+      // the first cut at or above every value: the figure there is the one of that value
+      const double low = fCuts.front(), high = fCuts.back();
+      for (int ip = 0; ip < nPoints; ip++) {
+         double value = low + (high - low)*ip/(nPoints - 1);
+         points.push_back( std::lower_bound( fCuts.begin(), fCuts.end(), value ) - fCuts.begin() );
+      }
+      points.push_back( GetBest( figure ) );
+      std::sort( points.begin(), points.end() );
+      points.erase( std::unique( points.begin(), points.end() ), points.end() );
+   }
+
+   TGraphErrors* graph = new TGraphErrors( points.size() );
+   for (size_t ip = 0; ip < points.size(); ip++) {
+      graph->SetPoint( ip, fCuts[points[ip]], fValues[figure][points[ip]] );
+      graph->SetPointError( ip, 0, GetError( figure, points[ip] ) );
+   }
+   return graph;
+}
+
+#endif
@@ -0,0 +1,295 @@
+// Class: BDTEventLoop
+// Reads and scores the (tree, class, weight) samples of a channel in one pass,
+// spread over worker threads, and keeps the result in memory so that the
+// histograms can be filled afterwards in the original event order.
+// With a BDTColumnCache the columns and weights are read in place from the
+// memory-mapped column files instead, and only the scoring is spread.
+//
+// Each worker opens its own TFile/TTree, reads only the branches it needs
+// for a range of entries, and scores the range with the (immutable, shared)
+// BDTForest. Filling stays serial and in input order, so the histograms are
+// identical to the ones of the old per-tree GetEntry/EvaluateMVA loops,
+// whatever the number of workers: BDTForest gives the response of
+// TMVA::Reader bit by bit, events exactly on a cut value included.
+//
+// usage:
+//
+//     std::vector<BDTSample> samples;
+//     samples.push_back( BDTSample( "file.root", "tau_DIS", true, weight ) );
+//     BDTEventLoop loop( forest, nworkers );     // nworkers = 0: all cores
+//     loop.SetCache( &cache );                   // optional, see BDTColumnCache.h
+//     loop.AddColumn( "enu" );                   // spectators/plot-only branches
+//     loop.Process( samples );
+//     BDTSampleData& data = loop.GetSampleData( 0 );
+//     data.SetBranchAddress( "zdec", &zdec );
+//     for (Long64_t j=0; j<data.GetEntries(); j++) {
+//         data.GetEntry(j);
+//         h->Fill( zdec, data.GetWeight(j) );
+//     }
+//
+
+#ifndef BDTEventLoop__def
+#define BDTEventLoop__def
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TFile.h"
+#include "TROOT.h"
+#include "TString.h"
+#include "TTree.h"
+
+#include "BDTChannel.h"
+#include "BDTColumnCache.h"
+#include "BDTForest.h"
+#include "BDTTreeReader.h"
+
+// the branches, BDT response and event weight of one sample, column-wise
+class BDTSampleData {
+
+ public:
+
+   BDTSampleData() : fEntries( 0 ), fWeightData( 0 ), fFile( 0 ) {}
+
+   Long64_t GetEntries() const { return fEntries; }
+
+   // column of branch "name", 0 if it was not read
+   const float* GetColumn( const char* name ) const {
+      for (size_t i = 0; i < fNames.size(); i++)
+         if (fNames[i] == name) return fColumnData[i];
+      return 0;
+   }
+
+   // TTree-like access: GetEntry(j) copies entry j into the given addresses
+   bool SetBranchAddress( const char* name, Float_t* address ) { return Bind( name, address, 0 ); }
+   bool SetBranchAddress( const char* name, Int_t* address )   { return Bind( name, 0, address ); }
+   void GetEntry( Long64_t j ) const {
+      for (size_t i = 0; i < fFloatAddress.size(); i++) {
+         if (fFloatAddress[i]) *fFloatAddress[i] = fColumnData[i][j];
+         if (fIntAddress[i])   *fIntAddress[i]   = Int_t( fColumnData[i][j] );
+      }
+   }
+
+   double GetMvaValue( Long64_t j ) const { return fMva[j]; }
+   // OscillationP times the sample weight, rounded to Float_t as in the old loops
+   Float_t GetWeight( Long64_t j ) const { return fWeightData[j]; }
+
+ private:
+
+   friend class BDTEventLoop;
+
+   bool Bind( const char* name, Float_t* f, Int_t* i ) {
+      for (size_t k = 0; k < fNames.size(); k++) {
+         if (fNames[k] != name) continue;
+         fFloatAddress[k] = f;
+         fIntAddress[k]   = i;
+         return true;
+      }
+      std::cout << "Problem in class \"BDTSampleData\": no column " << name << std::endl;
+      return false;
+   }
+
+   Long64_t                          fEntries;
+   std::vector<std::string>          fNames;
+   std::vector<const float*>         fColumnData;  // into fColumns or into the column file
+   const Float_t*                    fWeightData;
+   std::vector< std::vector<float> > fColumns;     // read from the tree (no cache)
+   std::vector<Float_t>              fWeight;
+   const BDTColumnFile*              fFile;        // cached sample, or 0
+   std::vector<double>               fMva;
+   std::vector<Float_t*>             fFloatAddress;
+   std::vector<Int_t*>               fIntAddress;
+};
+
+class BDTEventLoop {
+
+ public:
+
+   // nWorkers = 0 uses all the cores
+   BDTEventLoop( const BDTForest& forest, int nWorkers = 0 )
+      : fForest( forest ), fNWorkers( nWorkers ), fChunkSize( 20000 ), fCache( 0 )
+   {
+      if (fNWorkers <= 0) fNWorkers = std::max( 1u, std::thread::hardware_concurrency() );
+      fColumns = fForest.GetInputVariables();
+      fOptional.assign( fColumns.size(), false );
+      fDefault.assign( fColumns.size(), 0 );
+      AddColumn( "OscillationP" );
+   }
+
+   // an extra branch to read besides the BDT inputs; an optional one is
+   // set to defaultValue in the trees that do not have it
+   void AddColumn( const char* name, bool optional = false, float defaultValue = 0 ) {
+      if (std::find( fColumns.begin(), fColumns.end(), std::string(name) ) != fColumns.end()) return;
+      fColumns.push_back( name );
+      fOptional.push_back( optional );
+      fDefault.push_back( defaultValue );
+   }
+
+   int GetNWorkers() const { return fNWorkers; }
+
+   // reads the samples from the column files of "cache" (0: from the trees);
+   // the cache must outlive the sample data
+   void SetCache( BDTColumnCache* cache ) { fCache = cache; }
+
+   // reads and scores every sample; returns false if a file, tree or branch is missing
+   bool Process( const std::vector<BDTSample>& samples );
+
+   size_t GetNSamples() const { return fData.size(); }
+   BDTSampleData& GetSampleData( size_t isample ) { return fData[isample]; }
+
+ private:
+
+   struct Task {
+      size_t   fSample;
+      Long64_t fFirst;
+      Long64_t fLast;
+   };
+
+   bool ProcessTasks( const std::vector<BDTSample>& samples, const std::vector<Task>& tasks,
+                      std::atomic<size_t>& next );
+
+   const BDTForest&          fForest;
+   int                       fNWorkers;
+   Long64_t                  fChunkSize;
+   BDTColumnCache*           fCache;
+   std::vector<std::string>  fColumns;
+   std::vector<bool>         fOptional;
+   std::vector<float>        fDefault;
+   std::vector<BDTSampleData> fData;
+};
+
+//_______________________________________________________________________
+inline bool BDTEventLoop::Process( const std::vector<BDTSample>& samples )
+{
+   if (!fForest.IsStatusClean()) {
+      std::cout << "Problem in class \"BDTEventLoop\": BDT forest status is dirty" << std::endl;
+      return false;
+   }
+
+   // size the output and cut every sample in chunks of entries
+   fData.assign( samples.size(), BDTSampleData() );
+   std::vector<Task> tasks;
+   for (size_t is = 0; is < samples.size(); is++) {
+      BDTSampleData& data = fData[is];
+      data.fNames = fColumns;
+      data.fFloatAddress.assign( fColumns.size(), 0 );
+      data.fIntAddress.assign( fColumns.size(), 0 );
+
+      Long64_t entries;
+      if (fCache) {
+         // columns and weights in place, in the mapped column file
+         data.fFile = fCache->Get( samples[is] );
+         if (!data.fFile) return false;
+         entries = data.fFile->GetEntries();
+         for (size_t ic = 0; ic < fColumns.size(); ic++) {
+            data.fColumnData.push_back( data.fFile->GetColumn( fColumns[ic] ) );
+            if (!data.fColumnData.back()) {
+               std::cout << "Problem in class \"BDTEventLoop\": no column " << fColumns[ic]
+                         << " in " << data.fFile->GetPath() << std::endl;
+               return false;
+            }
+         }
+         data.fWeightData = data.fFile->GetWeight();
+      }
+      else {
+         TFile* input = TFile::Open( samples[is].fFileName );
+         TTree* tree  = input ? (TTree*)input->Get( samples[is].fTreeName ) : 0;
+         if (!tree) {
+            std::cout << "Problem in class \"BDTEventLoop\": cannot read tree " << samples[is].fTreeName
+                      << " from " << samples[is].fFileName << std::endl;
+            delete input;
+            return false;
+         }
+         entries = tree->GetEntries();
+         delete input;
+
+         data.fColumns.assign( fColumns.size(), std::vector<float>( entries ) );
+         data.fWeight.assign( entries, 0 );
+         for (size_t ic = 0; ic < fColumns.size(); ic++) data.fColumnData.push_back( data.fColumns[ic].data() );
+         data.fWeightData = data.fWeight.data();
+      }
+      data.fEntries = entries;
+      data.fMva.assign( entries, 0 );
+
+      Long64_t chunk = std::min( fChunkSize, entries/fNWorkers + 1 );
+      for (Long64_t first = 0; first < entries; first += chunk) {
+         Task task = { is, first, std::min( first + chunk, entries ) };
+         tasks.push_back( task );
+      }
+   }
+
+   std::atomic<size_t> next( 0 );
+   int nThreads = std::min<int>( fNWorkers, tasks.size() );
+   if (nThreads <= 1) return ProcessTasks( samples, tasks, next );
+
+   ROOT::EnableThreadSafety();
+   std::vector<std::thread> workers;
+   std::vector<char> ok( nThreads, 0 );
+   for (int iw = 0; iw < nThreads; iw++)
+      workers.push_back( std::thread( [&, iw]() { ok[iw] = ProcessTasks( samples, tasks, next ); } ) );
+   for (int iw = 0; iw < nThreads; iw++) workers[iw].join();
+   return std::count( ok.begin(), ok.end(), 0 ) == 0;
+}
+
+//_______________________________________________________________________
+inline bool BDTEventLoop::ProcessTasks( const std::vector<BDTSample>& samples, const std::vector<Task>& tasks,
+                                        std::atomic<size_t>& next )
+{
+   const size_t ncol = fColumns.size();
+   const size_t nvar = fForest.GetNvar();
+   const size_t iOsc = std::find( fColumns.begin(), fColumns.end(), std::string("OscillationP") ) - fColumns.begin();
+
+   std::vector<const float*> inputs( nvar );
+   std::vector<float*> buffers( ncol );
+
+   TFile* input   = 0;
+   TTree* tree    = 0;
+   BDTTreeReader* reader = 0;
+   size_t current = samples.size();
+   bool   status  = true;
+
+   for (size_t itask = next++; itask < tasks.size(); itask = next++) {
+      const Task& task = tasks[itask];
+      const BDTSample& sample = samples[task.fSample];
+      BDTSampleData& data = fData[task.fSample];
+
+      if (data.fFile) { // cached: nothing to read
+         for (size_t ivar = 0; ivar < nvar; ivar++) inputs[ivar] = data.fColumnData[ivar] + task.fFirst;
+         fForest.GetMvaValues( task.fLast - task.fFirst, inputs.data(), data.fMva.data() + task.fFirst );
+         continue;
+      }
+
+      if (task.fSample != current) {
+         delete reader;
+         delete input;
+         reader  = 0;
+         input   = TFile::Open( sample.fFileName );
+         tree    = input ? (TTree*)input->Get( sample.fTreeName ) : 0;
+         current = task.fSample;
+         if (!tree) { status = false; continue; }
+         reader  = new BDTTreeReader( tree, fColumns, fOptional, fDefault );
+         if (!reader->IsStatusClean()) status = false;
+      }
+      if (!tree) continue;
+
+      for (size_t ic = 0; ic < ncol; ic++) buffers[ic] = data.fColumns[ic].data() + task.fFirst;
+      reader->Read( task.fFirst, task.fLast, buffers.data() );
+      for (Long64_t j = task.fFirst; j < task.fLast; j++) {
+         Float_t weight = data.fColumns[iOsc][j];
+         weight *= sample.fWeight;
+         data.fWeight[j] = weight;
+      }
+
+      for (size_t ivar = 0; ivar < nvar; ivar++) inputs[ivar] = data.fColumnData[ivar] + task.fFirst;
+      fForest.GetMvaValues( task.fLast - task.fFirst, inputs.data(), data.fMva.data() + task.fFirst );
+   }
+   delete reader;
+   delete input;
+   return status;
+}
+
+#endif
@@ -0,0 +1,366 @@
+// Class: BDTForest
+// Flat (structure-of-arrays) evaluator for the AdaBoost BDT written by
+// MethodBDT into dataset/weights/TMVAClassification_ch<N>_BDT.weights.xml
+//
+// Every tree is padded to a complete binary tree of the forest depth, so an
+// event descends with  i = 2*i + 1 + goesRight  and no pointer chasing.
+// Leaves already hold boostWeight*nodeType, summed in tree order and divided
+// by the sum of boost weights exactly as MethodBDT::PrivateGetMvaValue does:
+// the response is bit-identical to TMVA::Reader::EvaluateMVA("BDT method"),
+// which compares Float_t inputs against Float_t cut values and sends an event
+// right when  value >= cut  (DecisionTreeNode::GoesRight).
+// (ReadBDT from the .class.C compares doubles against cuts printed with 6
+// digits and with  value > cut,  so it agrees with both only away from the cut
+// values: an input exactly on a cut, as the integer variables often are,
+// takes the other branch in ReadBDT.)
+//
+// usage:
+//
+//     BDTForest forest("dataset/weights/TMVAClassification_ch1_BDT.weights.xml");
+//     double mva = forest.GetMvaValue(inputValues);            // one event
+//     forest.GetMvaValues(nEvents, columns, mvaValues);       // columns[ivar][ievt]
+//
+
+#ifndef BDTForest__def
+#define BDTForest__def
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class BDTForest {
+
+ public:
+
+   // constructor: reads the forest from a MethodBDT weights file
+   BDTForest( const std::string& weightFile )
+      : fClassName( "BDTForest" ),
+        fStatusIsClean( false ),
+        fDepth( 0 ),
+        fNInternal( 0 ),
+        fNLeaves( 0 ),
+        fNorm( 0 )
+   {
+      fStatusIsClean = ReadWeightsXML( weightFile );
+   }
+
+   // returns classifier status
+   bool IsStatusClean() const { return fStatusIsClean; }
+
+   // the training input variables, in the order expected by GetMvaValue(s)
+   const std::vector<std::string>& GetInputVariables() const { return fInputVars; }
+   size_t GetNvar()   const { return fInputVars.size(); }
+   size_t GetNTrees() const { return fBoostWeights.size(); }
+   int    GetDepth()  const { return fDepth; }
+
+   // the classifier response for one event
+   // "inputValues" is a vector of input values in the same order as GetInputVariables()
+   double GetMvaValue( const float* inputValues ) const;
+   double GetMvaValue( const std::vector<float>& inputValues ) const { return GetMvaValue( &inputValues[0] ); }
+   double GetMvaValue( const std::vector<double>& inputValues ) const;
+
+   // the classifier response for nEvents events laid out column-wise:
+   // columns[ivar][ievt], ivar in the order of GetInputVariables()
+   void GetMvaValues( size_t nEvents, const float* const* columns, double* mvaValues ) const;
+
+   // the distinct cut values on variable ivar, ascending (to check the evaluators at ties)
+   const std::vector<float>& GetCutValues( size_t ivar ) const { return fVarCuts[ivar]; }
+
+ private:
+
+   // number of events descending the forest together in GetMvaValues
+   static const size_t kBlockSize = 256;
+
+   struct XMLNode {
+      int    fDepth;
+      char   fPos;       // 's'tart (root), 'l'eft or 'r'ight daughter
+      int    fSelector;
+      float  fCutValue;
+      bool   fCutType;
+      int    fNodeType;  // -1 == Bkg-leaf, 1 == Signal-leaf, 0 = internal
+      float  fPurity;
+   };
+
+   bool ReadWeightsXML( const std::string& weightFile );
+   bool Problem( const std::string& what ) const;
+
+   static bool GetAttribute( const std::string& tag, const char* name, std::string& value );
+   static std::string GetOption( const std::string& xml, const char* name );
+
+   // fills slot "slot" of tree "itree" with the subtree starting at nodes[inode],
+   // returns the index of the first node after the subtree
+   size_t FillTree( size_t itree, const std::vector<XMLNode>& nodes, size_t inode,
+                    size_t slot, int depth, double boostWeight );
+   void FillLeaves( size_t itree, size_t slot, int depth, double value );
+
+   const char* fClassName;
+   bool        fStatusIsClean;
+
+   std::vector<std::string> fInputVars;
+   bool                     fUseYesNoLeaf;
+
+   int    fDepth;      // depth of every (padded) tree
+   size_t fNInternal;  // 2^fDepth - 1 internal nodes per tree
+   size_t fNLeaves;    // 2^fDepth leaves per tree
+
+   // structure of arrays, tree-major: internal node "i" of tree "t" is at t*fNInternal + i
+   std::vector<int>           fSelector;     // index of the cut variable
+   std::vector<float>         fCutValue;     // cut value, as stored by DecisionTreeNode
+   std::vector<unsigned char> fCutType;      // 1: event variable >= cutValue goes right
+   std::vector<double>        fLeafResponse; // boostWeight*nodeType (or *purity), t*fNLeaves + leaf
+
+   std::vector< std::vector<float> > fVarCuts; // distinct cut values of every variable
+
+   std::vector<double> fBoostWeights;        // the weights applied in the individual boosts
+   double              fNorm;                // their sum, in tree order
+};
+
+//_______________________________________________________________________
+inline bool BDTForest::Problem( const std::string& what ) const
+{
+   std::cout << "Problem in class \"" << fClassName << "\": " << what << std::endl;
+   return false;
+}
+
+//_______________________________________________________________________
+inline bool BDTForest::GetAttribute( const std::string& tag, const char* name, std::string& value )
+{
+   std::string key = std::string(" ") + name + "=\"";
+   size_t begin = tag.find( key );
+   if (begin == std::string::npos) return false;
+   begin += key.size();
+   size_t end = tag.find( '"', begin );
+   if (end == std::string::npos) return false;
+   value = tag.substr( begin, end - begin );
+   return true;
+}
+
+//_______________________________________________________________________
+inline std::string BDTForest::GetOption( const std::string& xml, const char* name )
+{
+   std::string key = std::string("<Option name=\"") + name + "\"";
+   size_t begin = xml.find( key );
+   if (begin == std::string::npos) return "";
+   begin = xml.find( '>', begin );
+   size_t end = xml.find( '<', begin );
+   if (begin == std::string::npos || end == std::string::npos) return "";
+   return xml.substr( begin + 1, end - begin - 1 );
+}
+
+//_______________________________________________________________________
+inline bool BDTForest::ReadWeightsXML( const std::string& weightFile )
+{
+   std::ifstream in( weightFile.c_str() );
+   if (!in) return Problem( "cannot open weight file " + weightFile );
+   std::stringstream buffer;
+   buffer << in.rdbuf();
+   const std::string xml = buffer.str();
+
+   if (xml.find( "<MethodSetup Method=\"BDT::" ) == std::string::npos)
+      return Problem( weightFile + " is not a BDT weight file" );
+
+   std::string boostType = GetOption( xml, "BoostType" );
+   if (boostType == "Grad")
+      return Problem( "BoostType=Grad is not supported" );
+   fUseYesNoLeaf = (GetOption( xml, "UseYesNoLeaf" ) != "False");
+
+   std::string value;
+   size_t pos = xml.find( "<Transformations" );
+   if (pos != std::string::npos) {
+      GetAttribute( xml.substr( pos, xml.find( '>', pos ) - pos ), "NTransformations", value );
+      if (value != "0") return Problem( "variable transformations are not supported (VarTransform must be None)" );
+   }
+
+   // the training input variables
+   size_t endVars = xml.find( "</Variables>" );
+   for (pos = xml.find( "<Variable " ); pos < endVars; pos = xml.find( "<Variable ", pos + 1 )) {
+      std::string tag = xml.substr( pos, xml.find( '>', pos ) - pos );
+      if (!GetAttribute( tag, "Expression", value )) return Problem( "variable without expression" );
+      fInputVars.push_back( value );
+   }
+   if (fInputVars.empty()) return Problem( "empty input vector" );
+
+   // the trees, as flat lists of nodes in the order they are written (depth first)
+   std::vector< std::vector<XMLNode> > trees;
+   for (pos = xml.find( "<BinaryTree " ); pos != std::string::npos; pos = xml.find( "<BinaryTree ", pos + 1 )) {
+      std::string tag = xml.substr( pos, xml.find( '>', pos ) - pos );
+      if (!GetAttribute( tag, "boostWeight", value )) return Problem( "tree without boost weight" );
+      fBoostWeights.push_back( std::strtod( value.c_str(), 0 ) );
+
+      trees.push_back( std::vector<XMLNode>() );
+      size_t endTree = xml.find( "</BinaryTree>", pos );
+      for (size_t npos = xml.find( "<Node ", pos ); npos < endTree; npos = xml.find( "<Node ", npos + 1 )) {
+         std::string ntag = xml.substr( npos, xml.find( '>', npos ) - npos );
+         XMLNode node;
+         std::string depth, p, ivar, cut, ctype, ntype, purity, ncoef;
+         if (!GetAttribute( ntag, "depth", depth ) || !GetAttribute( ntag, "pos", p ) ||
+             !GetAttribute( ntag, "IVar", ivar ) || !GetAttribute( ntag, "Cut", cut ) ||
+             !GetAttribute( ntag, "cType", ctype ) || !GetAttribute( ntag, "nType", ntype ) ||
+             !GetAttribute( ntag, "purity", purity ))
+            return Problem( "incomplete <Node> in tree " + std::to_string( trees.size() - 1 ) );
+         if (GetAttribute( ntag, "NCoef", ncoef ) && ncoef != "0")
+            return Problem( "Fisher cuts (UseFisherCuts) are not supported" );
+         node.fDepth    = std::atoi( depth.c_str() );
+         node.fPos      = p.empty() ? 's' : p[0];
+         node.fSelector = std::atoi( ivar.c_str() );
+         node.fCutValue = float( std::strtod( cut.c_str(), 0 ) );
+         node.fCutType  = (std::atoi( ctype.c_str() ) != 0);
+         node.fNodeType = std::atoi( ntype.c_str() );
+         node.fPurity   = float( std::strtod( purity.c_str(), 0 ) );
+         if (node.fNodeType == 0 && (node.fSelector < 0 || node.fSelector >= int(fInputVars.size())))
+            return Problem( "cut on unknown variable in tree " + std::to_string( trees.size() - 1 ) );
+         if (node.fDepth > fDepth) fDepth = node.fDepth;
+         trees.back().push_back( node );
+      }
+      if (trees.back().empty()) return Problem( "empty tree " + std::to_string( trees.size() - 1 ) );
+   }
+   if (trees.empty()) return Problem( "no trees in " + weightFile );
+
+   fNInternal = (size_t(1) << fDepth) - 1;
+   fNLeaves   = size_t(1) << fDepth;
+   fSelector.assign( trees.size()*fNInternal, 0 );
+   fCutValue.assign( trees.size()*fNInternal, 0 );
+   fCutType.assign( trees.size()*fNInternal, 1 );
+   fLeafResponse.assign( trees.size()*fNLeaves, 0 );
+
+   fNorm = 0;
+   for (size_t itree = 0; itree < trees.size(); itree++) {
+      if (FillTree( itree, trees[itree], 0, 0, 0, fBoostWeights[itree] ) != trees[itree].size())
+         return Problem( "malformed tree " + std::to_string( itree ) );
+      fNorm += fBoostWeights[itree];
+   }
+
+   fVarCuts.assign( fInputVars.size(), std::vector<float>() );
+   for (size_t itree = 0; itree < trees.size(); itree++)
+      for (size_t inode = 0; inode < trees[itree].size(); inode++)
+         if (trees[itree][inode].fNodeType == 0)
+            fVarCuts[trees[itree][inode].fSelector].push_back( trees[itree][inode].fCutValue );
+   for (size_t ivar = 0; ivar < fVarCuts.size(); ivar++) {
+      std::sort( fVarCuts[ivar].begin(), fVarCuts[ivar].end() );
+      fVarCuts[ivar].erase( std::unique( fVarCuts[ivar].begin(), fVarCuts[ivar].end() ), fVarCuts[ivar].end() );
+   }
+   return true;
+}
+
+//_______________________________________________________________________
+inline size_t BDTForest::FillTree( size_t itree, const std::vector<XMLNode>& nodes, size_t inode,
+                                   size_t slot, int depth, double boostWeight )
+{
+   if (inode >= nodes.size() || nodes[inode].fDepth != depth) return nodes.size() + 1;
+   const XMLNode& node = nodes[inode];
+
+   if (node.fNodeType != 0) { // leaf: replicate it over the padded subtree below
+      FillLeaves( itree, slot, depth,
+                  boostWeight * (fUseYesNoLeaf ? double(node.fNodeType) : double(node.fPurity)) );
+      return inode + 1;
+   }
+
+   const size_t k = itree*fNInternal + slot;
+   fSelector[k] = node.fSelector;
+   fCutValue[k] = node.fCutValue;
+   fCutType[k]  = node.fCutType ? 1 : 0;
+
+   // daughters are written depth first, but do not rely on left coming first
+   size_t next = inode + 1;
+   for (int idaughter = 0; idaughter < 2; idaughter++) {
+      if (next >= nodes.size()) return nodes.size() + 1;
+      size_t daughterSlot = 2*slot + (nodes[next].fPos == 'r' ? 2 : 1);
+      next = FillTree( itree, nodes, next, daughterSlot, depth + 1, boostWeight );
+   }
+   return next;
+}
+
+//_______________________________________________________________________
+inline void BDTForest::FillLeaves( size_t itree, size_t slot, int depth, double value )
+{
+   if (depth == fDepth) {
+      fLeafResponse[itree*fNLeaves + (slot - fNInternal)] = value;
+      return;
+   }
+   // padding node: either way leads to the same leaf value
+   FillLeaves( itree, 2*slot + 1, depth + 1, value );
+   FillLeaves( itree, 2*slot + 2, depth + 1, value );
+}
+
+//_______________________________________________________________________
+inline double BDTForest::GetMvaValue( const float* inputValues ) const
+{
+   if (!fStatusIsClean) {
+      Problem( "cannot return classifier response because status is dirty" );
+      return 0;
+   }
+
+   double myMVA = 0;
+   for (size_t itree = 0; itree < fBoostWeights.size(); itree++) {
+      const int*           selector = fSelector.data() + itree*fNInternal;
+      const float*         cutValue = fCutValue.data() + itree*fNInternal;
+      const unsigned char* cutType  = fCutType.data() + itree*fNInternal;
+      size_t i = 0;
+      for (int d = 0; d < fDepth; d++)
+         i = 2*i + 1 + ((inputValues[selector[i]] >= cutValue[i]) == (cutType[i] != 0));
+      myMVA += fLeafResponse[itree*fNLeaves + (i - fNInternal)];
+   }
+   return (fNorm > std::numeric_limits<double>::epsilon()) ? myMVA / fNorm : 0;
+}
+
+//_______________________________________________________________________
+inline double BDTForest::GetMvaValue( const std::vector<double>& inputValues ) const
+{
+   // TMVA stores event variables as Float_t
+   std::vector<float> values( inputValues.begin(), inputValues.end() );
+   return GetMvaValue( &values[0] );
+}
+
+//_______________________________________________________________________
+inline void BDTForest::GetMvaValues( size_t nEvents, const float* const* columns, double* mvaValues ) const
+{
+   if (!fStatusIsClean) {
+      Problem( "cannot return classifier response because status is dirty" );
+      for (size_t ievt = 0; ievt < nEvents; ievt++) mvaValues[ievt] = 0;
+      return;
+   }
+
+   // each block of events is copied event-major once, so that a node lookup is a single
+   // indexed load whatever variable the node cuts on
+   const size_t nvar = fInputVars.size();
+   std::vector<float> block( kBlockSize*nvar );
+   double myMVA[kBlockSize];
+   unsigned int node[kBlockSize];
+
+   for (size_t first = 0; first < nEvents; first += kBlockSize) {
+      const size_t n = (nEvents - first < kBlockSize) ? nEvents - first : kBlockSize;
+      for (size_t ivar = 0; ivar < nvar; ivar++) {
+         const float* column = columns[ivar] + first;
+         for (size_t j = 0; j < n; j++) block[j*nvar + ivar] = column[j];
+      }
+      const float* x = block.data();
+      for (size_t j = 0; j < n; j++) myMVA[j] = 0;
+
+      for (size_t itree = 0; itree < fBoostWeights.size(); itree++) {
+         const int*           selector = fSelector.data() + itree*fNInternal;
+         const float*         cutValue = fCutValue.data() + itree*fNInternal;
+         const unsigned char* cutType  = fCutType.data() + itree*fNInternal;
+         const double*        leaf     = fLeafResponse.data() + itree*fNLeaves;
+
+         // one level at a time for the whole block: no branches, no dependencies between events
+         for (size_t j = 0; j < n; j++) node[j] = 0;
+         for (int d = 0; d < fDepth; d++) {
+            for (size_t j = 0; j < n; j++) {
+               const unsigned int i = node[j];
+               node[j] = 2*i + 1 + ((x[j*nvar + selector[i]] >= cutValue[i]) == (cutType[i] != 0));
+            }
+         }
+         for (size_t j = 0; j < n; j++) myMVA[j] += leaf[node[j] - fNInternal];
+      }
+
+      for (size_t j = 0; j < n; j++)
+         mvaValues[first + j] = (fNorm > std::numeric_limits<double>::epsilon()) ? myMVA[j] / fNorm : 0;
+   }
+}
+
+#endif
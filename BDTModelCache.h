@@ -0,0 +1,202 @@
+// Class: BDTModelCache
+// Trained models of a channel, content addressed: the output files of a
+// training (weight files, TMVA_<N>.root) are stored in cache/models/<md5>/,
+// the MD5 of everything the training depends on: content of the input files,
+// trees, fractions and weights of the samples, event weight expressions,
+// variables, cuts, split options, factory and method options and ROOT
+// version. When none of them changed the stored files are put back in place
+// and the training can be skipped.
+//
+// usage:
+//
+//     BDTModelCache models( cfg, samples, "OscillationP", "OscillationP", factoryOptions );
+//     models.AddMethod( "BDT", cfg.fBDTOptions );
+//     std::vector<std::string> files = { "dataset/weights/TMVAClassification_ch1_BDT.weights.xml", "TMVA_1.root" };
+//     if (!models.Restore( files )) {
+//        factory->TrainAllMethods(); ...
+//        models.Store( files );
+//     }
+//
+
+#ifndef BDTModelCache__def
+#define BDTModelCache__def
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "TMD5.h"
+#include "TROOT.h"
+#include "TString.h"
+#include "TSystem.h"
+
+#include "BDTChannel.h"
+
+class BDTModelCache {
+
+ public:
+
+   // the models trained on "samples" of channel "cfg", in directory "dir"
+   // signalWeight, backgroundWeight: the event weight expressions of the DataLoader
+   BDTModelCache( const BDTChannel& cfg, const std::vector<BDTSample>& samples,
+                  const std::string& signalWeight, const std::string& backgroundWeight,
+                  const std::string& factoryOptions, const std::string& dir = "cache/models" );
+
+   // a booked method and its options, part of the key
+   void AddMethod( const std::string& name, const std::string& options );
+
+   // description of the training and its MD5 (the directory of the model);
+   // empty if an input file cannot be read
+   const std::string& GetDescription();
+   std::string GetKey();
+
+   // true if all of "files" are stored for the current key
+   bool IsStored( const std::vector<std::string>& files );
+
+   // copies the stored files of the model to "files" (stored by base name);
+   // false if the model is not in the cache
+   bool Restore( const std::vector<std::string>& files );
+
+   // stores "files" as the model of the current key
+   bool Store( const std::vector<std::string>& files );
+
+ private:
+
+   std::string GetModelDir();
+
+   std::string fDir;
+   std::string fDescription;  // computed on first use
+   std::string fInputs;       // samples, weights, variables, cuts, factory options
+   std::string fMethods;
+};
+
+//_______________________________________________________________________
+inline BDTModelCache::BDTModelCache( const BDTChannel& cfg, const std::vector<BDTSample>& samples,
+                                     const std::string& signalWeight, const std::string& backgroundWeight,
+                                     const std::string& factoryOptions, const std::string& dir )
+   : fDir( dir )
+{
+   fInputs = "channel " + std::to_string( cfg.fChannel ) + "\n";
+   for (size_t is = 0; is < samples.size(); is++) {
+      std::string checksum = GetBDTFileChecksum( samples[is].fFileName );
+      if (checksum.empty()) {
+         std::cout << "Problem in class \"BDTModelCache\": cannot read " << samples[is].fFileName << std::endl;
+         fInputs.clear();
+         return;
+      }
+      fInputs += TString::Format( "sample %s %s %s %d %.17g %.9g\n", checksum.c_str(), samples[is].fFileName.Data(),
+                                  samples[is].fTreeName.Data(), samples[is].fIsSignal, samples[is].fWeight, samples[is].fFraction ).Data();
+   }
+   for (size_t ivar = 0; ivar < cfg.fVariables.size(); ivar++)
+      fInputs += std::string( "variable " ) + cfg.fVariables[ivar].fExpression + " " + cfg.fVariables[ivar].fType + "\n";
+   fInputs += "weight signal " + signalWeight + "\n";
+   fInputs += "weight background " + backgroundWeight + "\n";
+   fInputs += std::string( "cut signal " ) + cfg.fCutSignal.GetTitle() + "\n";
+   fInputs += std::string( "cut background " ) + cfg.fCutBackground.GetTitle() + "\n";
+   fInputs += std::string( "split " ) + cfg.fSplitOptions.Data() + "\n";
+   fInputs += "factory " + factoryOptions + "\n";
+   fInputs += std::string( "root " ) + gROOT->GetVersion() + "\n";
+}
+
+//_______________________________________________________________________
+inline void BDTModelCache::AddMethod( const std::string& name, const std::string& options )
+{
+   fMethods += "method " + name + " " + options + "\n";
+   fDescription.clear();
+}
+
+//_______________________________________________________________________
+inline const std::string& BDTModelCache::GetDescription()
+{
+   if (fDescription.empty() && !fInputs.empty()) fDescription = fInputs + fMethods;
+   return fDescription;
+}
+
+//_______________________________________________________________________
+inline std::string BDTModelCache::GetKey()
+{
+   const std::string& description = GetDescription();
+   if (description.empty()) return "";
+   TMD5 md5;
+   md5.Update( (const UChar_t*)description.data(), description.size() );
+   md5.Final();
+   return md5.AsString();
+}
+
+//_______________________________________________________________________
+inline std::string BDTModelCache::GetModelDir()
+{
+   std::string key = GetKey();
+   return key.empty() ? "" : fDir + "/" + key;
+}
+
+//_______________________________________________________________________
+inline bool BDTModelCache::IsStored( const std::vector<std::string>& files )
+{
+   std::string modelDir = GetModelDir();
+   if (modelDir.empty() || files.empty()) return false;
+   for (size_t i = 0; i < files.size(); i++) {
+      std::string stored = modelDir + "/" + gSystem->BaseName( files[i].c_str() );
+      if (gSystem->AccessPathName( stored.c_str() )) return false;
+   }
+   return true;
+}
+
+//_______________________________________________________________________
+inline bool BDTModelCache::Restore( const std::vector<std::string>& files )
+{
+   if (!IsStored( files )) return false;
+   std::string modelDir = GetModelDir();
+   for (size_t i = 0; i < files.size(); i++) {
+      std::string stored = modelDir + "/" + gSystem->BaseName( files[i].c_str() );
+      TString target = files[i];
+      gSystem->mkdir( gSystem->DirName( target ), true );
+      if (gSystem->CopyFile( stored.c_str(), target, kTRUE ) != 0) {
+         std::cout << "Problem in class \"BDTModelCache\": cannot copy " << stored << " to " << target << std::endl;
+         return false;
+      }
+   }
+   std::cout << "BDTModelCache: model restored from " << modelDir << std::endl;
+   return true;
+}
+
+//_______________________________________________________________________
+inline bool BDTModelCache::Store( const std::vector<std::string>& files )
+{
+   std::string modelDir = GetModelDir();
+   if (modelDir.empty()) return false;
+
+   // filled aside and renamed into place: a model directory is always complete
+   std::string tmpDir = modelDir + ".tmp" + std::to_string( getpid() );
+   gSystem->mkdir( tmpDir.c_str(), true );
+   std::vector<std::string> stored;
+   bool ok = true;
+   for (size_t i = 0; ok && i < files.size(); i++) {
+      stored.push_back( tmpDir + "/" + gSystem->BaseName( files[i].c_str() ) );
+      ok = gSystem->CopyFile( files[i].c_str(), stored.back().c_str(), kTRUE ) == 0;
+   }
+   if (ok) {
+      stored.push_back( tmpDir + "/key.txt" );
+      std::ofstream description( stored.back().c_str() );
+      description << GetDescription();
+      description.close();
+      gSystem->Unlink( modelDir.c_str() ); // an older copy of the same model, if empty
+      ok = gSystem->Rename( tmpDir.c_str(), modelDir.c_str() ) == 0 || !gSystem->AccessPathName( modelDir.c_str() );
+      if (!gSystem->AccessPathName( tmpDir.c_str() )) { // stored meanwhile by another process
+         for (size_t i = 0; i < stored.size(); i++) gSystem->Unlink( stored[i].c_str() );
+         gSystem->Unlink( tmpDir.c_str() );
+      }
+   }
+   else {
+      std::cout << "Problem in class \"BDTModelCache\": cannot store " << files[stored.size() - 1] << std::endl;
+      for (size_t i = 0; i < stored.size(); i++) gSystem->Unlink( stored[i].c_str() );
+      gSystem->Unlink( tmpDir.c_str() );
+   }
+   if (ok) std::cout << "BDTModelCache: model stored in " << modelDir << std::endl;
+   return ok;
+}
+
+#endif
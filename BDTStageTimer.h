@@ -0,0 +1,254 @@
+// Class: BDTStageTimer
+// Wall and CPU time, processed events and memory of the stages of a job
+// (opening the inputs, training, scoring loops, plots, ...), written as JSON
+// so that runs can be compared across changes. A stage started again
+// accumulates; starting a stage stops the running one.
+//
+// Memory is the resident size at the end of the stage and the peak resident
+// size of the process up to then, in kB.
+//
+// With SetOutputFile the JSON is also written when the timer is destroyed
+// before WriteJSON, e.g. by an early return on failure: the running stage is
+// stopped and "status" is "incomplete" in the info.
+//
+// usage:
+//
+//     BDTStageTimer timer( "TMVAClassification_ch1" );
+//     timer.SetOutputFile( "TMVAClassification_ch1_timing.json" );
+//     timer.AddInfo( "channel", "1" );
+//     timer.Start( "train" );
+//     factory->TrainAllMethods();
+//     timer.Stop( nTrainingEvents );
+//     ...
+//     timer.WriteJSON( "TMVAClassification_ch1_timing.json" );
+//
+// {
+//   "job": "TMVAClassification_ch1",
+//   "info": { "channel": "1", ... },
+//   "stages": [
+//     { "name": "train", "calls": 1, "real_s": 5.91, "cpu_s": 5.88, "events": 7979,
+//       "events_per_s": 1350.1, "rss_kb": 412345, "peak_rss_kb": 420111 },
+//     ...
+//   ],
+//   "total": { "real_s": ..., "cpu_s": ..., "peak_rss_kb": ... }
+// }
+//
+
+#ifndef BDTStageTimer__def
+#define BDTStageTimer__def
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "TDatime.h"
+#include "TROOT.h"
+#include "TStopwatch.h"
+#include "TSystem.h"
+
+class BDTStageTimer {
+
+ public:
+
+   BDTStageTimer( const std::string& job )
+      : fJob( job ), fRunning( -1 ), fWritten( false )
+   {
+      fTotal.Start();
+   }
+   ~BDTStageTimer();
+
+   // the JSON written by the destructor if WriteJSON was not called for it
+   void SetOutputFile( const std::string& fileName ) { fOutputFile = fileName; }
+
+   // metadata of the run, written under "info"
+   void AddInfo( const std::string& key, const std::string& value ) { fInfo.push_back( std::make_pair( key, value ) ); }
+
+   // starts (or resumes) "stage", stopping the running one
+   void Start( const std::string& stage );
+   // stops the running stage, adding "events" to its processed events
+   void Stop( Long64_t events = 0 );
+
+   double GetRealTime( const std::string& stage ) const;
+   Long64_t GetEvents( const std::string& stage ) const;
+
+   // one line per stage on std::cout
+   void Print() const;
+   bool WriteJSON( const std::string& fileName ) const;
+
+   // peak resident size of the process, kB
+   static long GetPeakMemory();
+
+ private:
+
+   struct Stage {
+      std::string fName;
+      mutable TStopwatch fWatch; // RealTime() and CpuTime() stop it
+      int         fCalls;
+      Long64_t    fEvents;
+      long        fMemResident;  // kB, at the end of the stage
+      long        fPeakMemory;   // kB, of the process at the end of the stage
+   };
+
+   int Find( const std::string& stage ) const;
+   static std::string Quote( const std::string& text );
+
+   std::string                                        fJob;
+   std::vector< std::pair<std::string, std::string> > fInfo;
+   std::vector<Stage>                                 fStages;
+   int                                                fRunning;
+   mutable TStopwatch                                 fTotal;
+   std::string                                        fOutputFile;
+   mutable bool                                       fWritten;   // fOutputFile
+};
+
+//_______________________________________________________________________
+inline BDTStageTimer::~BDTStageTimer()
+{
+   if (fOutputFile.empty() || fWritten) return;
+   if (fRunning >= 0) Stop();
+   AddInfo( "status", "incomplete" );
+   if (WriteJSON( fOutputFile )) std::cout << fJob << ": incomplete, timing written to " << fOutputFile << std::endl;
+}
+
+//_______________________________________________________________________
+inline int BDTStageTimer::Find( const std::string& stage ) const
+{
+   for (size_t is = 0; is < fStages.size(); is++)
+      if (fStages[is].fName == stage) return is;
+   return -1;
+}
+
+//_______________________________________________________________________
+inline void BDTStageTimer::Start( const std::string& stage )
+{
+   if (fRunning >= 0) Stop();
+   int is = Find( stage );
+   if (is < 0) {
+      Stage s;
+      s.fName = stage;
+      s.fCalls = 0;
+      s.fEvents = 0;
+      s.fMemResident = 0;
+      s.fPeakMemory = 0;
+      fStages.push_back( s );
+      is = fStages.size() - 1;
+      fStages[is].fWatch.Start( kTRUE );
+   }
+   else fStages[is].fWatch.Continue();
+   fStages[is].fCalls++;
+   fRunning = is;
+}
+
+//_______________________________________________________________________
+inline void BDTStageTimer::Stop( Long64_t events )
+{
+   if (fRunning < 0) {
+      std::cout << "Problem in class \"BDTStageTimer\": no stage is running" << std::endl;
+      return;
+   }
+   Stage& s = fStages[fRunning];
+   s.fWatch.Stop();
+   s.fEvents += events;
+   ProcInfo_t info;
+   gSystem->GetProcInfo( &info );
+   s.fMemResident = info.fMemResident;
+   s.fPeakMemory  = GetPeakMemory();
+   fRunning = -1;
+}
+
+//_______________________________________________________________________
+inline double BDTStageTimer::GetRealTime( const std::string& stage ) const
+{
+   int is = Find( stage );
+   return is < 0 ? 0 : fStages[is].fWatch.RealTime();
+}
+
+//_______________________________________________________________________
+inline Long64_t BDTStageTimer::GetEvents( const std::string& stage ) const
+{
+   int is = Find( stage );
+   return is < 0 ? 0 : fStages[is].fEvents;
+}
+
+//_______________________________________________________________________
+inline long BDTStageTimer::GetPeakMemory()
+{
+   struct rusage usage;
+   if (getrusage( RUSAGE_SELF, &usage ) != 0) return 0;
+#ifdef __APPLE__
+   return usage.ru_maxrss/1024; // bytes
+#else
+   return usage.ru_maxrss;      // kB
+#endif
+}
+
+//_______________________________________________________________________
+inline std::string BDTStageTimer::Quote( const std::string& text )
+{
+   std::string quoted = "\"";
+   for (size_t i = 0; i < text.size(); i++) {
+      if (text[i] == '"' || text[i] == '\\') quoted += '\\';
+      if ((unsigned char)text[i] < 0x20) quoted += ' ';
+      else quoted += text[i];
+   }
+   return quoted + "\"";
+}
+
+//_______________________________________________________________________
+inline void BDTStageTimer::Print() const
+{
+   for (size_t is = 0; is < fStages.size(); is++) {
+      TStopwatch& watch = fStages[is].fWatch;
+      const double real = watch.RealTime();
+      char line[256];
+      snprintf( line, sizeof( line ), "%-12s %9.3f s real %9.3f s cpu %12lld events %12.1f events/s %9ld kB peak",
+                fStages[is].fName.c_str(), real, watch.CpuTime(), fStages[is].fEvents,
+                real > 0 ? fStages[is].fEvents/real : 0., fStages[is].fPeakMemory );
+      std::cout << fJob << ": " << line << std::endl;
+   }
+}
+
+//_______________________________________________________________________
+inline bool BDTStageTimer::WriteJSON( const std::string& fileName ) const
+{
+   std::ofstream out( fileName.c_str() );
+   if (!out) {
+      std::cout << "Problem in class \"BDTStageTimer\": cannot write " << fileName << std::endl;
+      return false;
+   }
+   char buffer[512];
+   out << "{" << std::endl
+       << "  \"job\": " << Quote( fJob ) << "," << std::endl
+       << "  \"info\": {" << std::endl
+       << "    \"date\": " << Quote( TDatime().AsSQLString() ) << "," << std::endl
+       << "    \"host\": " << Quote( gSystem->HostName() ) << "," << std::endl
+       << "    \"root\": " << Quote( gROOT->GetVersion() );
+   for (size_t i = 0; i < fInfo.size(); i++) out << "," << std::endl << "    " << Quote( fInfo[i].first ) << ": " << Quote( fInfo[i].second );
+   out << std::endl << "  }," << std::endl
+       << "  \"stages\": [";
+   for (size_t is = 0; is < fStages.size(); is++) {
+      const Stage& s = fStages[is];
+      TStopwatch& watch = s.fWatch;
+      const double real = watch.RealTime();
+      snprintf( buffer, sizeof( buffer ), "\"calls\": %d, \"real_s\": %.6f, \"cpu_s\": %.6f, \"events\": %lld, \"events_per_s\": %.1f, "
+                "\"rss_kb\": %ld, \"peak_rss_kb\": %ld }", s.fCalls, real, watch.CpuTime(), s.fEvents,
+                real > 0 ? s.fEvents/real : 0., s.fMemResident, s.fPeakMemory );
+      out << (is ? "," : "") << std::endl << "    { \"name\": " << Quote( s.fName ) << ", " << buffer;
+   }
+   fTotal.Stop();
+   snprintf( buffer, sizeof( buffer ), "{ \"real_s\": %.6f, \"cpu_s\": %.6f, \"peak_rss_kb\": %ld }",
+             fTotal.RealTime(), fTotal.CpuTime(), GetPeakMemory() );
+   fTotal.Continue();
+   out << std::endl << "  ]," << std::endl
+       << "  \"total\": " << buffer << std::endl
+       << "}" << std::endl;
+   if (out.good() && fileName == fOutputFile) fWritten = true;
+   return out.good();
+}
+
+#endif
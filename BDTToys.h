@@ -0,0 +1,265 @@
+// Class: BDTToys
+// Propagation of the measurement errors of a candidate event to its BDT
+// response: the candidate is smeared nToys times, every variable with a
+// bifurcated Gaussian of its (asymmetric) errors and independently of the
+// others, and the toys are scored with BDTForest in blocks, on threads.
+//
+// Gives the distribution of the response and the p-value against the
+// background shape  p(x) = P(background response >= x)  from h_bdt_B.
+//
+// The candidates are read from a table (candidates.txt):
+//
+//     channel  event  variable  value  err-  err+
+//
+// usage:
+//
+//     std::vector<BDTCandidate> candidates;
+//     ReadBDTCandidates( "candidates.txt", channel, candidates );
+//     BDTToys toys( forest, nworkers );
+//     toys.Run( candidates[0], 1000000 );
+//     TH1F* h = toys.MakeHistogram( "h_toys", 200, -1, 1 );
+//     double p = BDTToys::GetPValue( h_bdt_B, toys.GetNominal() );
+//
+// Toys are generated in chunks of fixed size, chunk c with the seeds
+// (seed, c, event): the result does not depend on the number of workers.
+//
+
+#ifndef BDTToys__def
+#define BDTToys__def
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TH1.h"
+#include "TH1F.h"
+
+#include "BDTForest.h"
+
+// one observed event: value and errors of every variable
+struct BDTCandidate {
+   std::string              fName;
+   std::vector<std::string> fVariables;
+   std::vector<double>      fValue;
+   std::vector<double>      fErrLow;   // err-, positive
+   std::vector<double>      fErrHigh;  // err+
+};
+
+//_______________________________________________________________________
+// the candidates of "channel" in the table "fileName", in order of appearance
+inline bool ReadBDTCandidates( const char* fileName, int channel, std::vector<BDTCandidate>& candidates )
+{
+   candidates.clear();
+   std::ifstream in( fileName );
+   if (!in) {
+      std::cout << "Problem in ReadBDTCandidates: cannot open " << fileName << std::endl;
+      return false;
+   }
+   std::string line;
+   for (int iline = 1; std::getline( in, line ); iline++) {
+      if (line.find( '#' ) != std::string::npos) line.erase( line.find( '#' ) );
+      std::istringstream fields( line );
+      int ch;
+      std::string name, variable;
+      double value, errLow, errHigh;
+      if (!(fields >> ch)) continue; // empty line
+      if (!(fields >> name >> variable >> value >> errLow >> errHigh) || errLow < 0 || errHigh < 0) {
+         std::cout << "Problem in ReadBDTCandidates: bad line " << iline << " in " << fileName << std::endl;
+         return false;
+      }
+      if (ch != channel) continue;
+
+      size_t ic = 0;
+      while (ic < candidates.size() && candidates[ic].fName != name) ic++;
+      if (ic == candidates.size()) {
+         candidates.push_back( BDTCandidate() );
+         candidates.back().fName = name;
+      }
+      candidates[ic].fVariables.push_back( variable );
+      candidates[ic].fValue.push_back( value );
+      candidates[ic].fErrLow.push_back( errLow );
+      candidates[ic].fErrHigh.push_back( errHigh );
+   }
+   return true;
+}
+
+class BDTToys {
+
+ public:
+
+   // nWorkers = 0 uses all the cores
+   BDTToys( const BDTForest& forest, int nWorkers = 0, unsigned int seed = 65539 )
+      : fForest( forest ), fNWorkers( nWorkers ), fSeed( seed ), fNominal( 0 )
+   {
+      if (fNWorkers <= 0) fNWorkers = std::max( 1u, std::thread::hardware_concurrency() );
+   }
+
+   // smears "candidate" nToys times and scores the toys; false if a BDT
+   // input is missing from the candidate
+   bool Run( const BDTCandidate& candidate, long nToys );
+
+   // the response of the central values, and of the toys (in toy order)
+   double GetNominal() const { return fNominal; }
+   const std::vector<float>& GetResponses() const { return fResponses; }
+
+   double GetMean() const;
+   double GetRMS() const;
+   // the response below which a fraction q of the toys lie
+   double GetQuantile( double q ) const;
+
+   // the distribution of the toy responses, owned by the caller
+   TH1F* MakeHistogram( const char* name, int nbins, double xmin, double xmax ) const;
+
+   // P(background response >= x) from the background histogram, linear within a bin
+   static double GetPValue( const TH1* hBkg, double x );
+   // p-values of the toys: median and central interval containing a fraction cl
+   void GetPValues( const TH1* hBkg, double& median, double& low, double& high, double cl = 0.6827 ) const;
+
+ private:
+
+   // toys generated with one seed
+   static const long kChunkSize = 65536;
+
+   const BDTForest&   fForest;
+   int                fNWorkers;
+   unsigned int       fSeed;
+   double             fNominal;
+   std::vector<float> fResponses;
+};
+
+//_______________________________________________________________________
+inline bool BDTToys::Run( const BDTCandidate& candidate, long nToys )
+{
+   // the candidate variables in the order of the forest inputs
+   const std::vector<std::string>& inputs = fForest.GetInputVariables();
+   const size_t nvar = inputs.size();
+   std::vector<double> value( nvar ), errLow( nvar ), errHigh( nvar );
+   for (size_t ivar = 0; ivar < nvar; ivar++) {
+      size_t k = std::find( candidate.fVariables.begin(), candidate.fVariables.end(), inputs[ivar] ) - candidate.fVariables.begin();
+      if (k == candidate.fVariables.size()) {
+         std::cout << "Problem in class \"BDTToys\": candidate " << candidate.fName << " has no " << inputs[ivar] << std::endl;
+         return false;
+      }
+      value[ivar]   = candidate.fValue[k];
+      errLow[ivar]  = candidate.fErrLow[k];
+      errHigh[ivar] = candidate.fErrHigh[k];
+   }
+   std::vector<float> central( value.begin(), value.end() );
+   fNominal = fForest.GetMvaValue( central );
+
+   nToys = std::max( 0L, nToys );
+   fResponses.assign( nToys, 0 );
+   const long nChunks = (nToys + kChunkSize - 1)/kChunkSize;
+   const unsigned int id = std::hash<std::string>()( candidate.fName );
+   std::atomic<long> next( 0 );
+
+   auto worker = [&]() {
+      std::vector< std::vector<float> > columns( nvar, std::vector<float>( kChunkSize ) );
+      std::vector<const float*> pointers( nvar );
+      std::vector<double> mva( kChunkSize );
+      std::normal_distribution<double> gauss( 0, 1 );
+      std::uniform_real_distribution<double> uniform( 0, 1 );
+      for (long c = next++; c < nChunks; c = next++) {
+         std::seed_seq seeds = { fSeed, (unsigned int)c, id };
+         std::mt19937 random( seeds );
+         const long first = c*kChunkSize;
+         const long n     = std::min( kChunkSize, nToys - first );
+         for (size_t ivar = 0; ivar < nvar; ivar++) {
+            float* x = columns[ivar].data();
+            const double lo = errLow[ivar], hi = errHigh[ivar];
+            if (lo == 0 && hi == 0) {
+               std::fill( x, x + n, central[ivar] );
+               continue;
+            }
+            // bifurcated Gaussian: side chosen with probability proportional to its width
+            for (long j = 0; j < n; j++) {
+               double g = std::fabs( gauss( random ) );
+               x[j] = (uniform( random )*(lo + hi) < lo) ? value[ivar] - lo*g : value[ivar] + hi*g;
+            }
+         }
+         for (size_t ivar = 0; ivar < nvar; ivar++) pointers[ivar] = columns[ivar].data();
+         fForest.GetMvaValues( n, pointers.data(), mva.data() );
+         for (long j = 0; j < n; j++) fResponses[first + j] = mva[j];
+      }
+   };
+   std::vector<std::thread> workers;
+   for (int iw = 1; iw < std::min<long>( fNWorkers, nChunks ); iw++) workers.push_back( std::thread( worker ) );
+   worker();
+   for (size_t iw = 0; iw < workers.size(); iw++) workers[iw].join();
+   return true;
+}
+
+//_______________________________________________________________________
+inline double BDTToys::GetMean() const
+{
+   double s = 0;
+   for (size_t j = 0; j < fResponses.size(); j++) s += fResponses[j];
+   return fResponses.empty() ? fNominal : s/fResponses.size();
+}
+
+//_______________________________________________________________________
+inline double BDTToys::GetRMS() const
+{
+   if (fResponses.empty()) return 0;
+   const double mean = GetMean();
+   double s2 = 0;
+   for (size_t j = 0; j < fResponses.size(); j++) s2 += (fResponses[j] - mean)*(fResponses[j] - mean);
+   return std::sqrt( s2/fResponses.size() );
+}
+
+//_______________________________________________________________________
+inline double BDTToys::GetQuantile( double q ) const
+{
+   if (fResponses.empty()) return fNominal;
+   std::vector<float> sorted( fResponses );
+   size_t k = std::min( sorted.size() - 1, size_t( std::max( 0., q )*sorted.size() ) );
+   std::nth_element( sorted.begin(), sorted.begin() + k, sorted.end() );
+   return sorted[k];
+}
+
+//_______________________________________________________________________
+inline TH1F* BDTToys::MakeHistogram( const char* name, int nbins, double xmin, double xmax ) const
+{
+   TH1F* h = new TH1F( name, "BDT response of the toys; BDT response; toys", nbins, xmin, xmax );
+   for (size_t j = 0; j < fResponses.size(); j++) h->Fill( fResponses[j] );
+   return h;
+}
+
+//_______________________________________________________________________
+inline double BDTToys::GetPValue( const TH1* hBkg, double x )
+{
+   const int nbins = hBkg->GetNbinsX();
+   const double total = hBkg->Integral( 0, nbins + 1 );
+   if (total <= 0) return 0;
+   int bin = hBkg->FindFixBin( x );
+   double above = hBkg->Integral( bin + 1, nbins + 1 );
+   if (bin >= 1 && bin <= nbins) {
+      const double low = hBkg->GetXaxis()->GetBinLowEdge( bin ), width = hBkg->GetXaxis()->GetBinWidth( bin );
+      above += hBkg->GetBinContent( bin )*(low + width - x)/width;
+   }
+   else if (bin == 0) above += hBkg->GetBinContent( 0 );
+   return above/total;
+}
+
+//_______________________________________________________________________
+inline void BDTToys::GetPValues( const TH1* hBkg, double& median, double& low, double& high, double cl ) const
+{
+   if (fResponses.empty()) {
+      median = low = high = GetPValue( hBkg, fNominal );
+      return;
+   }
+   // p(x) decreases with x: the quantiles of the responses map onto the p-values
+   median = GetPValue( hBkg, GetQuantile( 0.5 ) );
+   low    = GetPValue( hBkg, GetQuantile( 0.5*(1 + cl) ) );
+   high   = GetPValue( hBkg, GetQuantile( 0.5*(1 - cl) ) );
+}
+
+#endif
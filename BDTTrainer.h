@@ -0,0 +1,984 @@
+// Class: BDTTrainer
+// Native AdaBoost training of the BDT of a channel, a faster alternative to
+// booking TMVA::Types::kBDT. Every input variable is quantized once into at
+// most 256 bins (one per value when it has fewer distinct values, equally
+// populated otherwise) kept as one byte per event; the trees then grow level
+// by level from weight histograms of the bin codes, filled on nWorkers threads
+// over variables and blocks of events.
+//
+// The training follows MethodBDT with the booked options: signal and
+// background weights normalised to the number of events, Gini index gain with
+// the minimum node size of DecisionTree::TrainNodeFast (in events and in
+// weight), yes/no leaves from NodePurityLimit, AdaBoost with AdaBoostBeta on
+// the bagged sample (Poisson(BaggedSampleFraction) copies of every event,
+// redrawn after each tree), negative weights boosted inversely. Cuts lie
+// between bins: with nCuts=-1 the search is exact for the variables with at
+// most 256 values (gammadecvtx, charge2ry), binned for the others.
+//
+// The forest is written as a MethodBDT weights XML, read by TMVA::Reader and
+// BDTForest, and as the standalone ReadBDT class (.class.C).
+//
+// usage:
+//
+//     BDTTrainer trainer( cfg, cfg.fBDTOptions, nworkers );
+//     trainer.AddEvent( values, isSignal, weight );       // values in cfg.fVariables order
+//     trainer.Train();
+//     trainer.WriteWeightsXML( "dataset/weights/BDTTrainer_ch1_BDT.weights.xml" );
+//     trainer.WriteClass( "dataset/weights/BDTTrainer_ch1_BDT.class.C" );
+//
+
+#ifndef BDTTrainer__def
+#define BDTTrainer__def
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TDatime.h"
+#include "TROOT.h"
+#include "TString.h"
+#include "TSystem.h"
+
+#include "BDTChannel.h"
+
+class BDTTrainer {
+
+ public:
+
+   // options in the syntax of BookMethod( kBDT ); nWorkers = 0 uses all the cores
+   BDTTrainer( const BDTChannel& cfg, const TString& options, int nWorkers = 0 );
+   ~BDTTrainer() { StopWorkers(); }
+
+   // false if an option is not supported
+   bool IsStatusClean() const { return fStatusIsClean; }
+
+   // one training event: the variables in the order of cfg.fVariables, and
+   // optionally the spectators (GetBDTSpectators order), for their ranges only
+   void AddEvent( const float* values, bool isSignal, double weight, const float* spectators = 0 );
+   size_t GetNEvents() const { return fWeight.size(); }
+
+   bool Train();
+
+   size_t GetNTrees() const { return fTrees.size(); }
+   double GetTrainingTime() const { return fTrainingTime; } // s
+
+   // the forest as MethodBDT writes it
+   bool WriteWeightsXML( const std::string& fileName ) const;
+   bool WriteClass( const std::string& fileName, const std::string& className = "ReadBDT" ) const;
+
+ private:
+
+   static const int    kMaxBins   = 256;
+   static const size_t kBlockSize = 16384; // events per histogram task
+
+   struct Node {
+      int   fSelector;  // -1 for a leaf
+      float fCutValue;
+      bool  fCutType;   // true: event variable > cutValue goes right (never equal on training values)
+      int   fNodeType;  // -1 == Bkg-leaf, 1 == Signal-leaf, 0 = internal
+      float fPurity;
+      int   fDepth;
+      int   fLeft, fRight;
+   };
+
+   bool Problem( const std::string& what ) const;
+   bool SetOption( const std::string& name, const std::string& value );
+
+   void Quantize();
+   // grows a tree on the events of "sample" (repeated for bagging), returns
+   // the leaf of every entry of the sample in "leaf"
+   std::vector<Node> BuildTree( const std::vector<unsigned int>& sample, const std::vector<double>& weight,
+                                std::vector<int>& leaf );
+
+   void WriteNode( std::ostream& out, const std::vector<Node>& tree, int inode, char pos, int indent ) const;
+   void WriteClassNode( std::ostream& out, const std::vector<Node>& tree, int inode ) const;
+
+   // runs task(0 ... nTasks-1) on the workers and the calling thread
+   void RunTasks( size_t nTasks, const std::function<void( size_t )>& task );
+   void StartWorkers();
+   void StopWorkers();
+   void WorkerLoop( int generation );
+
+   const char* fClassName;
+   bool        fStatusIsClean;
+
+   std::vector<BDTVariable> fVariables;
+   std::vector<BDTVariable> fSpectators;
+
+   // options
+   std::set<std::string> fModified;
+   int         fNTrees;
+   int         fMaxDepth;
+   std::string fMinNodeSizeString;
+   double      fMinNodeSize;      // %
+   int         fNCuts;
+   double      fAdaBoostBeta;
+   bool        fUseBaggedBoost;
+   double      fBaggedSampleFraction;
+   double      fNodePurityLimit;
+
+   // training events, column-wise
+   std::vector< std::vector<float> > fValues;
+   std::vector<char>                 fIsSignal;
+   std::vector<double>               fWeight;
+   std::vector<float>                fMin, fMax, fSpecMin, fSpecMax;
+
+   // quantization: bin codes, variable-major, and the cut between bins k and k+1
+   std::vector<unsigned char>        fCodes;
+   std::vector<unsigned char>        fSampleCodes; // of the sample of the current tree
+   std::vector< std::vector<float> > fBinCuts; // NaN: no cut between the bins
+   std::vector<size_t>               fBinOffset; // of each variable in a node histogram
+   size_t                            fNBinsTotal;
+
+   // the forest
+   std::vector< std::vector<Node> > fTrees;
+   std::vector<double>              fBoostWeights;
+   double                           fTrainingTime;
+
+   // worker threads
+   int                             fNWorkers;
+   std::vector<std::thread>        fThreads;
+   std::mutex                      fMutex;
+   std::condition_variable         fWake, fDone;
+   const std::function<void( size_t )>* fTask;
+   size_t                          fNTasks;
+   std::atomic<size_t>             fNext;
+   int                             fGeneration;
+   int                             fBusy;
+   bool                            fStop;
+};
+
+//_______________________________________________________________________
+inline BDTTrainer::BDTTrainer( const BDTChannel& cfg, const TString& options, int nWorkers )
+   : fClassName( "BDTTrainer" ), fStatusIsClean( true ),
+     fVariables( cfg.fVariables ), fSpectators( GetBDTSpectators() ),
+     // MethodBDT defaults
+     fNTrees( 800 ), fMaxDepth( 3 ), fMinNodeSizeString( "5%" ), fMinNodeSize( 5 ), fNCuts( 20 ),
+     fAdaBoostBeta( 0.5 ), fUseBaggedBoost( false ), fBaggedSampleFraction( 0.6 ), fNodePurityLimit( 0.5 ),
+     fValues( cfg.fVariables.size() ),
+     fMin( cfg.fVariables.size(), std::numeric_limits<float>::max() ),
+     fMax( cfg.fVariables.size(), -std::numeric_limits<float>::max() ),
+     fSpecMin( fSpectators.size(), 0 ), fSpecMax( fSpectators.size(), 0 ),
+     fNBinsTotal( 0 ), fTrainingTime( 0 ),
+     fNWorkers( nWorkers ), fTask( 0 ), fNTasks( 0 ), fNext( 0 ), fGeneration( 0 ), fBusy( 0 ), fStop( false )
+{
+   if (fNWorkers <= 0) fNWorkers = std::max( 1u, std::thread::hardware_concurrency() );
+
+   std::string list( options.Data() );
+   size_t begin = 0;
+   while (begin <= list.size()) {
+      size_t end = list.find( ':', begin );
+      if (end == std::string::npos) end = list.size();
+      std::string token = list.substr( begin, end - begin );
+      begin = end + 1;
+      if (token.empty()) continue;
+      size_t eq = token.find( '=' );
+      if (eq == std::string::npos) { // flag: "Name" or "!Name"
+         bool negated = (token[0] == '!');
+         if (!SetOption( token.substr( negated ? 1 : 0 ), negated ? "False" : "True" )) fStatusIsClean = false;
+      }
+      else if (!SetOption( token.substr( 0, eq ), token.substr( eq + 1 ) )) fStatusIsClean = false;
+   }
+}
+
+//_______________________________________________________________________
+inline bool BDTTrainer::Problem( const std::string& what ) const
+{
+   std::cout << "Problem in class \"" << fClassName << "\": " << what << std::endl;
+   return false;
+}
+
+//_______________________________________________________________________
+inline bool BDTTrainer::SetOption( const std::string& name, const std::string& value )
+{
+   std::string v( value );
+   std::transform( v.begin(), v.end(), v.begin(), ::tolower );
+   const bool flag = (v == "true" || v == "t" || v == "1");
+   fModified.insert( name );
+
+   if (name == "H" || name == "V" || name == "VerbosityLevel" || name == "CreateMVAPdfs") return true;
+   if (name == "NTrees")               { fNTrees = std::atoi( v.c_str() ); return fNTrees > 0 || Problem( "NTrees must be positive" ); }
+   if (name == "MaxDepth")             { fMaxDepth = std::atoi( v.c_str() ); return fMaxDepth > 0 || Problem( "MaxDepth must be positive" ); }
+   if (name == "MinNodeSize")          { fMinNodeSizeString = value; fMinNodeSize = std::atof( v.c_str() ); return true; }
+   if (name == "nCuts")                { fNCuts = std::atoi( v.c_str() ); return true; }
+   if (name == "AdaBoostBeta")         { fAdaBoostBeta = std::atof( v.c_str() ); return true; }
+   if (name == "UseBaggedBoost")       { fUseBaggedBoost = flag; return true; }
+   if (name == "BaggedSampleFraction") { fBaggedSampleFraction = std::atof( v.c_str() ); return true; }
+   if (name == "NodePurityLimit")      { fNodePurityLimit = std::atof( v.c_str() ); return true; }
+   if (name == "BoostType")       return v == "adaboost"   || Problem( "only BoostType=AdaBoost is supported" );
+   if (name == "SeparationType")  return v == "giniindex"  || Problem( "only SeparationType=GiniIndex is supported" );
+   if (name == "UseYesNoLeaf")    return flag              || Problem( "only UseYesNoLeaf is supported" );
+   if (name == "VarTransform")    return v == "none"       || Problem( "variable transformations are not supported (VarTransform must be None)" );
+   if (name == "PruneMethod")     return v == "nopruning"  || Problem( "pruning is not supported" );
+   if (name == "UseRandomisedTrees" || name == "UseFisherCuts" || name == "DoPreselection" || name == "DoBoostMonitor")
+      return !flag || Problem( name + " is not supported" );
+   return Problem( "unknown or unsupported option " + name );
+}
+
+//_______________________________________________________________________
+inline void BDTTrainer::AddEvent( const float* values, bool isSignal, double weight, const float* spectators )
+{
+   for (size_t ivar = 0; ivar < fValues.size(); ivar++) {
+      fValues[ivar].push_back( values[ivar] );
+      fMin[ivar] = std::min( fMin[ivar], values[ivar] );
+      fMax[ivar] = std::max( fMax[ivar], values[ivar] );
+   }
+   if (spectators) {
+      for (size_t ispec = 0; ispec < fSpectators.size(); ispec++) {
+         if (fWeight.empty() || spectators[ispec] < fSpecMin[ispec]) fSpecMin[ispec] = spectators[ispec];
+         if (fWeight.empty() || spectators[ispec] > fSpecMax[ispec]) fSpecMax[ispec] = spectators[ispec];
+      }
+   }
+   fIsSignal.push_back( isSignal );
+   fWeight.push_back( weight );
+}
+
+//_______________________________________________________________________
+inline void BDTTrainer::Quantize()
+{
+   const size_t nevt = fWeight.size(), nvar = fValues.size();
+   const size_t maxBins = (fNCuts > 0) ? std::min<size_t>( fNCuts + 1, kMaxBins ) : kMaxBins;
+   fCodes.assign( nvar*nevt, 0 );
+   fBinCuts.assign( nvar, std::vector<float>() );
+   fBinOffset.assign( nvar, 0 );
+   fNBinsTotal = 0;
+
+   auto quantize = [&]( size_t ivar ) {
+      std::vector<float> all( fValues[ivar] );
+      std::sort( all.begin(), all.end() );
+      std::vector<float> sorted;  // the distinct values
+      std::unique_copy( all.begin(), all.end(), std::back_inserter( sorted ) );
+      // lower edges of bins 1, 2, ...: a new bin starts at the first value past the next quantile
+      std::vector<float>& cuts = fBinCuts[ivar];
+      std::vector<float>  lower;
+      if (sorted.size() <= maxBins) {
+         lower.assign( sorted.begin() + 1, sorted.end() );
+      }
+      else {
+         size_t bin = 1;
+         for (size_t j = 1; j < all.size() && bin < maxBins; j++) {
+            if (all[j] == all[j - 1] || double( j ) < double( bin )*all.size()/maxBins) continue;
+            lower.push_back( all[j] );
+            while (bin < maxBins && double( j ) >= double( bin )*all.size()/maxBins) bin++;
+         }
+      }
+      // cut between bin k and k+1: halfway between the last value of k and lower[k],
+      // strictly between the two, so that both  value > cut  (ReadBDT) and
+      // value >= cut  (TMVA::Reader, BDTForest) hold exactly for the values of the
+      // bins above k; NaN (no cut there) when the two are neighbouring floats
+      size_t idistinct = 0;
+      for (size_t k = 0; k < lower.size(); k++) {
+         while (sorted[idistinct + 1] < lower[k]) idistinct++;
+         float below = sorted[idistinct];
+         float cut   = float( 0.5*(double( below ) + double( lower[k] )) );
+         if (!(cut > below && cut < lower[k])) cut = std::nextafter( below, lower[k] );
+         cuts.push_back( (cut < lower[k]) ? cut : std::numeric_limits<float>::quiet_NaN() );
+      }
+      unsigned char* code = fCodes.data() + ivar*nevt;
+      for (size_t ievt = 0; ievt < nevt; ievt++)
+         code[ievt] = std::upper_bound( lower.begin(), lower.end(), fValues[ivar][ievt] ) - lower.begin();
+   };
+   RunTasks( nvar, quantize );
+
+   for (size_t ivar = 0; ivar < nvar; ivar++) {
+      fBinOffset[ivar] = fNBinsTotal;
+      fNBinsTotal += fBinCuts[ivar].size() + 1;
+   }
+}
+
+//_______________________________________________________________________
+inline std::vector<BDTTrainer::Node> BDTTrainer::BuildTree( const std::vector<unsigned int>& sample,
+                                                            const std::vector<double>& weight, std::vector<int>& leaf )
+{
+   const size_t nocc = sample.size(), nvar = fValues.size(), nevt = fWeight.size();
+   // DecisionTree::BuildTree: the minimum node size in events of the (bagged) sample
+   const double minSize = fMinNodeSize/100.*nocc;
+
+   std::vector<Node> tree( 1 );
+   Node root = { -1, 0, true, 0, 0, 0, -1, -1 };
+   tree[0] = root;
+   leaf.assign( nocc, 0 );  // current node of every entry
+   std::vector<int> open( 1, 0 );
+
+   // the bin codes and weights of the entries of the sample, contiguous for the histograms
+   fSampleCodes.resize( nvar*nocc );
+   auto gather = [&]( size_t ivar ) {
+      const unsigned char* code = fCodes.data() + ivar*nevt;
+      unsigned char* sampleCode = fSampleCodes.data() + ivar*nocc;
+      for (size_t k = 0; k < nocc; k++) sampleCode[k] = code[sample[k]];
+   };
+   RunTasks( nvar, gather );
+   std::vector<double> w( nocc );
+   std::vector<char>   isSignal( nocc );
+   for (size_t k = 0; k < nocc; k++) {
+      w[k]        = weight[sample[k]];
+      isSignal[k] = fIsSignal[sample[k]];
+   }
+
+   const size_t nblocks = (nocc + kBlockSize - 1)/kBlockSize;
+   std::vector<double> hist;
+   std::vector<long>   offset( nocc ); // of the histograms of the node of the entry, -1 if not split
+
+   while (!open.empty()) {
+      // weights of the open nodes
+      std::vector<int> local( tree.size(), -1 );
+      for (size_t j = 0; j < open.size(); j++) local[open[j]] = j;
+      std::vector<double> s( open.size(), 0 ), b( open.size(), 0 ), n( open.size(), 0 );
+      for (size_t k = 0; k < nocc; k++) {
+         int j = local[leaf[k]];
+         if (j < 0) continue;
+         if (isSignal[k]) s[j] += w[k];
+         else             b[j] += w[k];
+         n[j] += 1;
+      }
+
+      // the nodes that may be split, their slot in the histograms
+      std::vector<int> split( open.size(), -1 );
+      std::vector<int> splitNodes;
+      for (size_t j = 0; j < open.size(); j++) {
+         Node& node = tree[open[j]];
+         node.fPurity = (s[j] + b[j] > 0) ? s[j]/(s[j] + b[j]) : -1;
+         if (n[j] >= 2*minSize && s[j] + b[j] >= 2*minSize && node.fDepth < fMaxDepth && s[j] != 0 && b[j] != 0) {
+            split[j] = splitNodes.size();
+            splitNodes.push_back( j );
+         }
+      }
+
+      // histograms (signal weight, background weight, entries) of every variable in
+      // every node to split, one set per block of events
+      const size_t nodeSize = fNBinsTotal*3;
+      hist.assign( nblocks*splitNodes.size()*nodeSize, 0 );
+      if (!splitNodes.empty()) {
+         for (size_t k = 0; k < nocc; k++) {
+            int j = local[leaf[k]];
+            offset[k] = (j < 0 || split[j] < 0) ? -1 : long( split[j]*nodeSize );
+         }
+         auto fill = [&]( size_t itask ) {
+            const size_t ivar = itask%nvar, iblock = itask/nvar;
+            const unsigned char* code = fSampleCodes.data() + ivar*nocc;
+            double* h = hist.data() + iblock*splitNodes.size()*nodeSize + fBinOffset[ivar]*3;
+            const size_t last = std::min( nocc, (iblock + 1)*kBlockSize );
+            for (size_t k = iblock*kBlockSize; k < last; k++) {
+               if (offset[k] < 0) continue;
+               double* bin = h + offset[k] + code[k]*3;
+               bin[isSignal[k] ? 0 : 1] += w[k];
+               bin[2] += 1;
+            }
+         };
+         RunTasks( nblocks*nvar, fill );
+         for (size_t iblock = 1; iblock < nblocks; iblock++) {
+            const double* h = hist.data() + iblock*splitNodes.size()*nodeSize;
+            for (size_t i = 0; i < splitNodes.size()*nodeSize; i++) hist[i] += h[i];
+         }
+      }
+
+      // best cut of every node to split: Gini index gain, as TrainNodeFast
+      std::vector<int> selector( open.size(), -1 ), cutBin( open.size(), -1 );
+      std::vector<char> cutType( open.size(), 1 );
+      for (size_t is = 0; is < splitNodes.size(); is++) {
+         const int j = splitNodes[is];
+         const double nTotS = s[j], nTotB = b[j], nTot = n[j];
+         auto gini = []( double sig, double bkg ) {
+            return (sig <= 0 || bkg <= 0) ? 0. : sig*bkg/((sig + bkg)*(sig + bkg));
+         };
+         const double parent = (nTotS + nTotB)*gini( nTotS, nTotB );
+         double best = -1;
+         for (size_t ivar = 0; ivar < nvar; ivar++) {
+            const double* h = hist.data() + is*nodeSize + fBinOffset[ivar]*3;
+            double selS = 0, selB = 0, selN = 0;
+            for (size_t k = 0; k < fBinCuts[ivar].size(); k++) {
+               selS += h[3*k]; selB += h[3*k + 1]; selN += h[3*k + 2];
+               if (std::isnan( fBinCuts[ivar][k] )) continue; // no float between the bins
+               if (selN < minSize || nTot - selN < minSize || selS + selB < minSize || nTotS + nTotB - selS - selB < minSize) continue;
+               if (selN == 0 || selN == nTot) continue;
+               if (nTotS - selS == selS && nTotB - selB == selB) continue; // no gain
+               double gain = (parent - (nTotS - selS + nTotB - selB)*gini( nTotS - selS, nTotB - selB )
+                                     - (selS + selB)*gini( selS, selB ))/(nTotS + nTotB);
+               if (gain > best) {
+                  best         = gain;
+                  selector[j]  = ivar;
+                  cutBin[j]    = k;
+                  cutType[j]   = (selS/nTotS > selB/nTotB);
+               }
+            }
+         }
+         if (best < std::numeric_limits<double>::epsilon()) selector[j] = -1; // nothing to gain: leaf
+      }
+
+      // split the nodes, the others become leaves
+      std::vector<int> next;
+      std::vector<int> daughter( open.size(), -1 ); // index of the left daughter, right = left + 1
+      for (size_t j = 0; j < open.size(); j++) {
+         Node& node = tree[open[j]];
+         if (selector[j] < 0) {
+            node.fNodeType = (node.fPurity >= fNodePurityLimit) ? 1 : -1;
+            continue;
+         }
+         node.fSelector = selector[j];
+         node.fCutValue = fBinCuts[selector[j]][cutBin[j]];
+         node.fCutType  = cutType[j];
+         node.fNodeType = 0;
+         Node d = { -1, 0, true, 0, 0, node.fDepth + 1, -1, -1 };
+         node.fLeft  = tree.size();
+         node.fRight = tree.size() + 1;
+         daughter[j] = tree.size();
+         tree.push_back( d );
+         tree.push_back( d );
+         next.push_back( daughter[j] );
+         next.push_back( daughter[j] + 1 );
+      }
+      for (size_t k = 0; k < nocc; k++) {
+         int j = local[leaf[k]];
+         if (j < 0 || daughter[j] < 0) continue;
+         const unsigned char code = fSampleCodes[selector[j]*nocc + k];
+         const bool right = ((code > cutBin[j]) == (cutType[j] != 0));
+         leaf[k] = daughter[j] + (right ? 1 : 0);
+      }
+      open.swap( next );
+   }
+   return tree;
+}
+
+//_______________________________________________________________________
+inline bool BDTTrainer::Train()
+{
+   if (!fStatusIsClean) return Problem( "cannot train because status is dirty" );
+   const size_t nevt = fWeight.size();
+   double sumSig = 0, sumBkg = 0;
+   for (size_t ievt = 0; ievt < nevt; ievt++) (fIsSignal[ievt] ? sumSig : sumBkg) += fWeight[ievt];
+   if (sumSig <= 0 || sumBkg <= 0) return Problem( "no signal or no background events to train on" );
+   if (nevt >= std::numeric_limits<unsigned int>::max()) return Problem( "too many events" );
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   // the workers pay off only on enough events
+   if (fNWorkers > 1 && nevt*fValues.size() >= 4*kBlockSize) StartWorkers();
+   Quantize();
+
+   // MethodBDT::InitEventSample: signal and background weights summing to nevt/2 each
+   std::vector<double> boost( nevt );
+   for (size_t ievt = 0; ievt < nevt; ievt++)
+      boost[ievt] = fIsSignal[ievt] ? nevt/(2*sumSig) : nevt/(2*sumBkg);
+   std::vector<double> weight( nevt );
+
+   fTrees.clear();
+   fBoostWeights.clear();
+   std::vector<unsigned int> sample;
+   std::vector<int> leaf;
+   for (int itree = 0; itree < fNTrees; itree++) {
+      // MethodBDT::GetBaggedSubSample, with the seed it uses for this tree
+      sample.clear();
+      if (fUseBaggedBoost) {
+         // Poisson copies by inversion of the cumulative distribution
+         std::mt19937 random( 100*itree + 1234 );
+         const double p0 = std::exp( -fBaggedSampleFraction );
+         for (size_t ievt = 0; ievt < nevt; ievt++) {
+            const double u = random()*(1./4294967296.);
+            double p = p0, cumulative = p0;
+            for (int copies = 0; u >= cumulative && p > 0; cumulative += p) {
+               p *= fBaggedSampleFraction/++copies;
+               sample.push_back( ievt );
+            }
+         }
+      }
+      if (sample.empty()) {
+         sample.resize( nevt );
+         for (size_t ievt = 0; ievt < nevt; ievt++) sample[ievt] = ievt;
+      }
+      for (size_t ievt = 0; ievt < nevt; ievt++) weight[ievt] = fWeight[ievt]*boost[ievt];
+      fTrees.push_back( BuildTree( sample, weight, leaf ) );
+      const std::vector<Node>& tree = fTrees.back();
+
+      // MethodBDT::AdaBoost on the training sample, entry by entry (a bagged event
+      // is boosted once per copy)
+      double sumw = 0, sumwFalse = 0;
+      for (size_t k = 0; k < sample.size(); k++) {
+         const unsigned int ievt = sample[k];
+         const double w = fWeight[ievt]*boost[ievt];
+         sumw += w;
+         if ((tree[leaf[k]].fNodeType > fNodePurityLimit) != (fIsSignal[ievt] != 0)) sumwFalse += w;
+      }
+      const double err = sumwFalse/sumw;
+      if (err <= 0) { // perfect separation: nothing left to boost
+         fBoostWeights.push_back( 1 );
+         break;
+      }
+      const double boostWeight = std::log( (1 - err)/err )*fAdaBoostBeta;
+      const double boostFactor = std::exp( boostWeight );
+      double newSumw = 0;
+      for (size_t k = 0; k < sample.size(); k++) {
+         const unsigned int ievt = sample[k];
+         if ((tree[leaf[k]].fNodeType > fNodePurityLimit) != (fIsSignal[ievt] != 0)) {
+            if (fWeight[ievt] > 0) boost[ievt] *= boostFactor;
+            else                   boost[ievt] /= boostFactor; // InverseBoostNegWeights
+         }
+         newSumw += fWeight[ievt]*boost[ievt];
+      }
+      const double norm = sumw/newSumw;
+      for (size_t k = 0; k < sample.size(); k++) boost[sample[k]] *= norm;
+
+      if (!(boostWeight > 0)) { // error fraction >= 0.5: the tree is kept with no weight, as MethodBDT does
+         std::cout << "BDTTrainer: stopped boosting at tree " << itree << " (error fraction " << err << ")" << std::endl;
+         fBoostWeights.push_back( 0 );
+         break;
+      }
+      fBoostWeights.push_back( boostWeight );
+   }
+   StopWorkers();
+   fTrainingTime = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+   return true;
+}
+
+//_______________________________________________________________________
+inline void BDTTrainer::WriteNode( std::ostream& out, const std::vector<Node>& tree, int inode, char pos, int indent ) const
+{
+   const Node& node = tree[inode];
+   char line[512];
+   snprintf( line, sizeof( line ),
+             "<Node pos=\"%c\" depth=\"%d\" NCoef=\"0\" IVar=\"%d\" Cut=\"%.16e\" cType=\"%d\" res=\"%.16e\" rms=\"%.16e\" purity=\"%.16e\" nType=\"%d\"",
+             pos, node.fDepth, node.fSelector, double( node.fCutValue ), node.fCutType ? 1 : 0, -99., 0., double( node.fPurity ), node.fNodeType );
+   out << std::string( indent, ' ' ) << line;
+   if (node.fNodeType != 0) {
+      out << "/>" << std::endl;
+      return;
+   }
+   out << ">" << std::endl;
+   WriteNode( out, tree, node.fLeft,  'l', indent + 2 );
+   WriteNode( out, tree, node.fRight, 'r', indent + 2 );
+   out << std::string( indent, ' ' ) << "</Node>" << std::endl;
+}
+
+//_______________________________________________________________________
+inline bool BDTTrainer::WriteWeightsXML( const std::string& fileName ) const
+{
+   if (fTrees.empty()) return Problem( "no trained forest to write" );
+   std::ofstream out( fileName.c_str() );
+   if (!out) return Problem( "cannot write " + fileName );
+   char buffer[256];
+
+   UserGroup_t* user = gSystem->GetUserInfo();
+   out << "<?xml version=\"1.0\"?>" << std::endl
+       << "<MethodSetup Method=\"BDT::BDT\">" << std::endl
+       << "  <GeneralInfo>" << std::endl
+       // the release of the node format written below, read back by TMVA::Reader
+       << "    <Info name=\"TMVA Release\" value=\"4.2.1 [262657]\"/>" << std::endl
+       << "    <Info name=\"ROOT Release\" value=\"" << gROOT->GetVersion() << " [" << gROOT->GetVersionCode() << "]\"/>" << std::endl
+       << "    <Info name=\"Creator\" value=\"" << (user ? user->fUser.Data() : "") << "\"/>" << std::endl
+       << "    <Info name=\"Date\" value=\"" << TDatime().AsString() << "\"/>" << std::endl
+       << "    <Info name=\"Host\" value=\"" << gSystem->HostName() << "\"/>" << std::endl
+       << "    <Info name=\"Dir\" value=\"" << gSystem->WorkingDirectory() << "\"/>" << std::endl
+       << "    <Info name=\"Training events\" value=\"" << fWeight.size() << "\"/>" << std::endl;
+   snprintf( buffer, sizeof( buffer ), "%.8e", fTrainingTime );
+   out << "    <Info name=\"TrainingTime\" value=\"" << buffer << "\"/>" << std::endl
+       << "    <Info name=\"AnalysisType\" value=\"Classification\"/>" << std::endl
+       << "  </GeneralInfo>" << std::endl;
+   delete user;
+
+   // the options of MethodBDT as ROOT 6.08 writes them, those of the trainer with their values
+   std::vector< std::pair<std::string, std::string> > options;
+   auto real = []( double x ) { char b[32]; snprintf( b, sizeof( b ), "%.6e", x ); return std::string( b ); };
+   options.push_back( std::make_pair( "V", "False" ) );
+   options.push_back( std::make_pair( "VerbosityLevel", "Default" ) );
+   options.push_back( std::make_pair( "VarTransform", "None" ) );
+   options.push_back( std::make_pair( "H", "False" ) );
+   options.push_back( std::make_pair( "CreateMVAPdfs", "False" ) );
+   options.push_back( std::make_pair( "IgnoreNegWeightsInTraining", "False" ) );
+   options.push_back( std::make_pair( "NTrees", std::to_string( fNTrees ) ) );
+   options.push_back( std::make_pair( "MaxDepth", std::to_string( fMaxDepth ) ) );
+   options.push_back( std::make_pair( "MinNodeSize", fMinNodeSizeString ) );
+   options.push_back( std::make_pair( "nCuts", std::to_string( fNCuts ) ) );
+   options.push_back( std::make_pair( "BoostType", "AdaBoost" ) );
+   options.push_back( std::make_pair( "AdaBoostR2Loss", "quadratic" ) );
+   options.push_back( std::make_pair( "UseBaggedBoost", fUseBaggedBoost ? "True" : "False" ) );
+   options.push_back( std::make_pair( "Shrinkage", real( 1 ) ) );
+   options.push_back( std::make_pair( "AdaBoostBeta", real( fAdaBoostBeta ) ) );
+   options.push_back( std::make_pair( "UseRandomisedTrees", "False" ) );
+   options.push_back( std::make_pair( "UseNvars", "3" ) );
+   options.push_back( std::make_pair( "UsePoissonNvars", "True" ) );
+   options.push_back( std::make_pair( "BaggedSampleFraction", real( fBaggedSampleFraction ) ) );
+   options.push_back( std::make_pair( "UseYesNoLeaf", "True" ) );
+   options.push_back( std::make_pair( "NegWeightTreatment", "inverseboostnegweights" ) );
+   options.push_back( std::make_pair( "Css", real( 1 ) ) );
+   options.push_back( std::make_pair( "Cts_sb", real( 1 ) ) );
+   options.push_back( std::make_pair( "Ctb_ss", real( 1 ) ) );
+   options.push_back( std::make_pair( "Cbb", real( 1 ) ) );
+   options.push_back( std::make_pair( "NodePurityLimit", real( fNodePurityLimit ) ) );
+   options.push_back( std::make_pair( "SeparationType", "giniindex" ) );
+   options.push_back( std::make_pair( "RegressionLossFunctionBDTG", "huber" ) );
+   options.push_back( std::make_pair( "HuberQuantile", real( 0.7 ) ) );
+   options.push_back( std::make_pair( "DoBoostMonitor", "False" ) );
+   options.push_back( std::make_pair( "UseFisherCuts", "False" ) );
+   options.push_back( std::make_pair( "MinLinCorrForFisher", real( 0.8 ) ) );
+   options.push_back( std::make_pair( "UseExclusiveVars", "False" ) );
+   options.push_back( std::make_pair( "DoPreselection", "False" ) );
+   options.push_back( std::make_pair( "SigToBkgFraction", real( 1 ) ) );
+   options.push_back( std::make_pair( "PruneMethod", "nopruning" ) );
+   options.push_back( std::make_pair( "PruneStrength", real( 0 ) ) );
+   options.push_back( std::make_pair( "PruningValFraction", real( 0.5 ) ) );
+   options.push_back( std::make_pair( "SkipNormalization", "False" ) );
+   options.push_back( std::make_pair( "nEventsMin", "0" ) );
+   options.push_back( std::make_pair( "UseBaggedGrad", "False" ) );
+   options.push_back( std::make_pair( "GradBaggingFraction", real( 0.5 ) ) );
+   options.push_back( std::make_pair( "UseNTrainEvents", "0" ) );
+   options.push_back( std::make_pair( "NNodesMax", "0" ) );
+   out << "  <Options>" << std::endl;
+   for (size_t i = 0; i < options.size(); i++)
+      out << "    <Option name=\"" << options[i].first << "\" modified=\"" << (fModified.count( options[i].first ) ? "Yes" : "No")
+          << "\">" << options[i].second << "</Option>" << std::endl;
+   out << "  </Options>" << std::endl;
+
+   auto writeVariables = [&]( const char* tag, const char* index, const std::vector<BDTVariable>& variables,
+                              const std::vector<float>& min, const std::vector<float>& max ) {
+      for (size_t ivar = 0; ivar < variables.size(); ivar++) {
+         const BDTVariable& var = variables[ivar];
+         snprintf( buffer, sizeof( buffer ), "Min=\"%.8e\" Max=\"%.8e\"", double( min[ivar] ), double( max[ivar] ) );
+         out << "    <" << tag << " " << index << "=\"" << ivar << "\" Expression=\"" << var.fExpression
+             << "\" Label=\"" << var.fExpression << "\" Title=\"" << var.fTitle << "\" Unit=\"" << var.fUnit
+             << "\" Internal=\"" << var.fExpression << "\" Type=\"" << var.fType << "\" " << buffer << "/>" << std::endl;
+      }
+   };
+   out << "  <Variables NVar=\"" << fVariables.size() << "\">" << std::endl;
+   writeVariables( "Variable", "VarIndex", fVariables, fMin, fMax );
+   out << "  </Variables>" << std::endl
+       << "  <Spectators NSpec=\"" << fSpectators.size() << "\">" << std::endl;
+   writeVariables( "Spectator", "SpecIndex", fSpectators, fSpecMin, fSpecMax );
+   out << "  </Spectators>" << std::endl
+       << "  <Classes NClass=\"2\">" << std::endl
+       << "    <Class Name=\"Signal\" Index=\"0\"/>" << std::endl
+       << "    <Class Name=\"Background\" Index=\"1\"/>" << std::endl
+       << "  </Classes>" << std::endl
+       << "  <Transformations NTransformations=\"0\"/>" << std::endl
+       << "  <MVAPdfs/>" << std::endl
+       << "  <Weights NTrees=\"" << fTrees.size() << "\" AnalysisType=\"0\">" << std::endl;
+   for (size_t itree = 0; itree < fTrees.size(); itree++) {
+      snprintf( buffer, sizeof( buffer ), "%.16e", fBoostWeights[itree] );
+      out << "    <BinaryTree type=\"DecisionTree\" boostWeight=\"" << buffer << "\" itree=\"" << itree << "\">" << std::endl;
+      WriteNode( out, fTrees[itree], 0, 's', 6 );
+      out << "    </BinaryTree>" << std::endl;
+   }
+   out << "  </Weights>" << std::endl
+       << "</MethodSetup>" << std::endl;
+   return out.good() || Problem( "cannot write " + fileName );
+}
+
+//_______________________________________________________________________
+inline void BDTTrainer::WriteClassNode( std::ostream& out, const std::vector<Node>& tree, int inode ) const
+{
+   // BDTNode( left, right, selector, cutValue, cutType, nodeType, purity, response ):
+   // cuts with all their digits, so that ReadBDT agrees with TMVA::Reader
+   const Node& node = tree[inode];
+   out << "NN(" << std::endl;
+   if (node.fNodeType == 0) WriteClassNode( out, tree, node.fLeft );
+   else                     out << "0";
+   out << ", " << std::endl;
+   if (node.fNodeType == 0) WriteClassNode( out, tree, node.fRight );
+   else                     out << "0";
+   out << ", " << std::endl;
+   char buffer[128];
+   snprintf( buffer, sizeof( buffer ), "%d, %.17g, %d, %d, %g,-99) ", node.fSelector, double( node.fCutValue ),
+             node.fCutType ? 1 : 0, node.fNodeType, double( node.fPurity ) );
+   out << buffer;
+}
+
+//_______________________________________________________________________
+inline bool BDTTrainer::WriteClass( const std::string& fileName, const std::string& className ) const
+{
+   if (fTrees.empty()) return Problem( "no trained forest to write" );
+   std::ofstream out( fileName.c_str() );
+   if (!out) return Problem( "cannot write " + fileName );
+   const size_t nvar = fVariables.size();
+
+   out << "// Class: " << className << std::endl
+       << "// Automatically generated by BDTTrainer, in the layout of MethodBase::MakeClass" << std::endl
+       << "//" << std::endl << std::endl
+       << "/* configuration options =====================================================" << std::endl << std::endl
+       << "NTrees: \"" << fNTrees << "\"  MaxDepth: \"" << fMaxDepth << "\"  MinNodeSize: \"" << fMinNodeSizeString
+       << "\"  nCuts: \"" << fNCuts << "\"  BoostType: \"AdaBoost\"  AdaBoostBeta: \"" << fAdaBoostBeta << "\"" << std::endl
+       << "UseBaggedBoost: \"" << (fUseBaggedBoost ? "True" : "False") << "\"  BaggedSampleFraction: \"" << fBaggedSampleFraction
+       << "\"  SeparationType: \"giniindex\"  Training events: " << fWeight.size() << std::endl << std::endl
+       << "============================================================================ */" << std::endl << std::endl
+       << "#include <vector>" << std::endl
+       << "#include <cmath>" << std::endl
+       << "#include <string>" << std::endl
+       << "#include <iostream>" << std::endl << std::endl
+       << "#define NN new BDTNode" << std::endl << std::endl
+       << "#ifndef BDTNode__def" << std::endl
+       << "#define BDTNode__def" << std::endl << std::endl
+       << "class BDTNode {" << std::endl << std::endl
+       << "public:" << std::endl << std::endl
+       << "   // constructor of an essentially \"empty\" node floating in space" << std::endl
+       << "   BDTNode ( BDTNode* left,BDTNode* right," << std::endl
+       << "                          int selector, double cutValue, bool cutType, " << std::endl
+       << "                          int nodeType, double purity, double response ) :" << std::endl
+       << "   fLeft         ( left         )," << std::endl
+       << "   fRight        ( right        )," << std::endl
+       << "   fSelector     ( selector     )," << std::endl
+       << "   fCutValue     ( cutValue     )," << std::endl
+       << "   fCutType      ( cutType      )," << std::endl
+       << "   fNodeType     ( nodeType     )," << std::endl
+       << "   fPurity       ( purity       )," << std::endl
+       << "   fResponse     ( response     ){" << std::endl
+       << "   }" << std::endl << std::endl
+       << "   virtual ~BDTNode();" << std::endl << std::endl
+       << "   // test event if it decends the tree at this node to the right" << std::endl
+       << "   virtual bool GoesRight( const std::vector<double>& inputValues ) const;" << std::endl
+       << "   BDTNode* GetRight( void )  {return fRight; };" << std::endl << std::endl
+       << "   // test event if it decends the tree at this node to the left " << std::endl
+       << "   virtual bool GoesLeft ( const std::vector<double>& inputValues ) const;" << std::endl
+       << "   BDTNode* GetLeft( void ) { return fLeft; };   " << std::endl << std::endl
+       << "   // return  S/(S+B) (purity) at this node (from  training)" << std::endl << std::endl
+       << "   double GetPurity( void ) const { return fPurity; } " << std::endl
+       << "   // return the node type" << std::endl
+       << "   int    GetNodeType( void ) const { return fNodeType; }" << std::endl
+       << "   double GetResponse(void) const {return fResponse;}" << std::endl << std::endl
+       << "private:" << std::endl << std::endl
+       << "   BDTNode*   fLeft;     // pointer to the left daughter node" << std::endl
+       << "   BDTNode*   fRight;    // pointer to the right daughter node" << std::endl
+       << "   int                     fSelector; // index of variable used in node selection (decision tree)   " << std::endl
+       << "   double                  fCutValue; // cut value appplied on this node to discriminate bkg against sig" << std::endl
+       << "   bool                    fCutType;  // true: if event variable > cutValue ==> signal , false otherwise" << std::endl
+       << "   int                     fNodeType; // Type of node: -1 == Bkg-leaf, 1 == Signal-leaf, 0 = internal " << std::endl
+       << "   double                  fPurity;   // Purity of node from training" << std::endl
+       << "   double                  fResponse; // Regression response value of node" << std::endl
+       << "}; " << std::endl << std::endl
+       << "//_______________________________________________________________________" << std::endl
+       << "   BDTNode::~BDTNode()" << std::endl
+       << "{" << std::endl
+       << "   if (fLeft  != NULL) delete fLeft;" << std::endl
+       << "   if (fRight != NULL) delete fRight;" << std::endl
+       << "}; " << std::endl << std::endl
+       << "//_______________________________________________________________________" << std::endl
+       << "bool BDTNode::GoesRight( const std::vector<double>& inputValues ) const" << std::endl
+       << "{" << std::endl
+       << "   // test event if it decends the tree at this node to the right" << std::endl
+       << "   bool result;" << std::endl
+       << "     result = (inputValues[fSelector] > fCutValue );" << std::endl
+       << "   if (fCutType == true) return result; //the cuts are selecting Signal ;" << std::endl
+       << "   else return !result;" << std::endl
+       << "}" << std::endl << std::endl
+       << "//_______________________________________________________________________" << std::endl
+       << "bool BDTNode::GoesLeft( const std::vector<double>& inputValues ) const" << std::endl
+       << "{" << std::endl
+       << "   // test event if it decends the tree at this node to the left" << std::endl
+       << "   if (!this->GoesRight(inputValues)) return true;" << std::endl
+       << "   else return false;" << std::endl
+       << "}" << std::endl << std::endl
+       << "#endif" << std::endl << std::endl
+       << "#ifndef IClassifierReader__def" << std::endl
+       << "#define IClassifierReader__def" << std::endl << std::endl
+       << "class IClassifierReader {" << std::endl << std::endl
+       << " public:" << std::endl << std::endl
+       << "   // constructor" << std::endl
+       << "   IClassifierReader() : fStatusIsClean( true ) {}" << std::endl
+       << "   virtual ~IClassifierReader() {}" << std::endl << std::endl
+       << "   // return classifier response" << std::endl
+       << "   virtual double GetMvaValue( const std::vector<double>& inputValues ) const = 0;" << std::endl << std::endl
+       << "   // returns classifier status" << std::endl
+       << "   bool IsStatusClean() const { return fStatusIsClean; }" << std::endl << std::endl
+       << " protected:" << std::endl << std::endl
+       << "   bool fStatusIsClean;" << std::endl
+       << "};" << std::endl << std::endl
+       << "#endif" << std::endl << std::endl
+       << "class " << className << " : public IClassifierReader {" << std::endl << std::endl
+       << " public:" << std::endl << std::endl
+       << "   // constructor" << std::endl
+       << "   " << className << "( std::vector<std::string>& theInputVars ) " << std::endl
+       << "      : IClassifierReader()," << std::endl
+       << "        fClassName( \"" << className << "\" )," << std::endl
+       << "        fNvars( " << nvar << " )," << std::endl
+       << "        fIsNormalised( false )" << std::endl
+       << "   {      " << std::endl
+       << "      // the training input variables" << std::endl
+       << "      const char* inputVars[] = { ";
+   for (size_t ivar = 0; ivar < nvar; ivar++) out << (ivar ? ", " : "") << "\"" << fVariables[ivar].fExpression << "\"";
+   out << " };" << std::endl << std::endl
+       << "      // sanity checks" << std::endl
+       << "      if (theInputVars.size() <= 0) {" << std::endl
+       << "         std::cout << \"Problem in class \\\"\" << fClassName << \"\\\": empty input vector\" << std::endl;" << std::endl
+       << "         fStatusIsClean = false;" << std::endl
+       << "      }" << std::endl << std::endl
+       << "      if (theInputVars.size() != fNvars) {" << std::endl
+       << "         std::cout << \"Problem in class \\\"\" << fClassName << \"\\\": mismatch in number of input values: \"" << std::endl
+       << "                   << theInputVars.size() << \" != \" << fNvars << std::endl;" << std::endl
+       << "         fStatusIsClean = false;" << std::endl
+       << "      }" << std::endl << std::endl
+       << "      // validate input variables" << std::endl
+       << "      for (size_t ivar = 0; ivar < theInputVars.size(); ivar++) {" << std::endl
+       << "         if (theInputVars[ivar] != inputVars[ivar]) {" << std::endl
+       << "            std::cout << \"Problem in class \\\"\" << fClassName << \"\\\": mismatch in input variable names\" << std::endl" << std::endl
+       << "                      << \" for variable [\" << ivar << \"]: \" << theInputVars[ivar].c_str() << \" != \" << inputVars[ivar] << std::endl;" << std::endl
+       << "            fStatusIsClean = false;" << std::endl
+       << "         }" << std::endl
+       << "      }" << std::endl << std::endl
+       << "      // initialize min and max vectors (for normalisation)" << std::endl;
+   for (size_t ivar = 0; ivar < nvar; ivar++)
+      out << "      fVmin[" << ivar << "] = 0;" << std::endl << "      fVmax[" << ivar << "] = 0;" << std::endl;
+   out << std::endl << "      // initialize input variable types" << std::endl;
+   for (size_t ivar = 0; ivar < nvar; ivar++) out << "      fType[" << ivar << "] = '" << fVariables[ivar].fType << "';" << std::endl;
+   out << std::endl
+       << "      // initialize constants" << std::endl
+       << "      Initialize();" << std::endl << std::endl
+       << "   }" << std::endl << std::endl
+       << "   // destructor" << std::endl
+       << "   virtual ~" << className << "() {" << std::endl
+       << "      Clear(); // method-specific" << std::endl
+       << "   }" << std::endl << std::endl
+       << "   // the classifier response" << std::endl
+       << "   // \"inputValues\" is a vector of input values in the same order as the " << std::endl
+       << "   // variables given to the constructor" << std::endl
+       << "   double GetMvaValue( const std::vector<double>& inputValues ) const;" << std::endl << std::endl
+       << " private:" << std::endl << std::endl
+       << "   // method-specific destructor" << std::endl
+       << "   void Clear();" << std::endl << std::endl
+       << "   // common member variables" << std::endl
+       << "   const char* fClassName;" << std::endl << std::endl
+       << "   const size_t fNvars;" << std::endl
+       << "   size_t GetNvar()           const { return fNvars; }" << std::endl
+       << "   char   GetType( int ivar ) const { return fType[ivar]; }" << std::endl << std::endl
+       << "   // normalisation of input variables" << std::endl
+       << "   const bool fIsNormalised;" << std::endl
+       << "   bool IsNormalised() const { return fIsNormalised; }" << std::endl
+       << "   double fVmin[" << nvar << "];" << std::endl
+       << "   double fVmax[" << nvar << "];" << std::endl
+       << "   double NormVariable( double x, double xmin, double xmax ) const {" << std::endl
+       << "      // normalise to output range: [-1, 1]" << std::endl
+       << "      return 2*(x - xmin)/(xmax - xmin) - 1.0;" << std::endl
+       << "   }" << std::endl << std::endl
+       << "   // type of input variable: 'F' or 'I'" << std::endl
+       << "   char   fType[" << nvar << "];" << std::endl << std::endl
+       << "   // initialize internal variables" << std::endl
+       << "   void Initialize();" << std::endl
+       << "   double GetMvaValue__( const std::vector<double>& inputValues ) const;" << std::endl << std::endl
+       << "   // private members (method specific)" << std::endl
+       << "   std::vector<BDTNode*> fForest;       // i.e. root nodes of decision trees" << std::endl
+       << "   std::vector<double>                fBoostWeights; // the weights applied in the individual boosts" << std::endl
+       << "};" << std::endl << std::endl
+       << "double " << className << "::GetMvaValue__( const std::vector<double>& inputValues ) const" << std::endl
+       << "{" << std::endl
+       << "   double myMVA = 0;" << std::endl
+       << "   double norm  = 0;" << std::endl
+       << "   for (unsigned int itree=0; itree<fForest.size(); itree++){" << std::endl
+       << "      BDTNode *current = fForest[itree];" << std::endl
+       << "      while (current->GetNodeType() == 0) { //intermediate node" << std::endl
+       << "         if (current->GoesRight(inputValues)) current=(BDTNode*)current->GetRight();" << std::endl
+       << "         else current=(BDTNode*)current->GetLeft();" << std::endl
+       << "      }" << std::endl
+       << "      myMVA += fBoostWeights[itree] *  current->GetNodeType();" << std::endl
+       << "      norm  += fBoostWeights[itree];" << std::endl
+       << "   }" << std::endl
+       << "   return myMVA /= norm;" << std::endl
+       << "};" << std::endl << std::endl
+       << "void " << className << "::Initialize()" << std::endl
+       << "{" << std::endl;
+   char buffer[64];
+   for (size_t itree = 0; itree < fTrees.size(); itree++) {
+      snprintf( buffer, sizeof( buffer ), "%.15g", fBoostWeights[itree] );
+      out << "  // itree = " << itree << std::endl
+          << "  fBoostWeights.push_back(" << buffer << ");" << std::endl
+          << "  fForest.push_back( " << std::endl;
+      WriteClassNode( out, fTrees[itree], 0 );
+      out << "   );" << std::endl;
+   }
+   out << "   return;" << std::endl
+       << "};" << std::endl << std::endl
+       << "// Clean up" << std::endl
+       << "inline void " << className << "::Clear() " << std::endl
+       << "{" << std::endl
+       << "   for (unsigned int itree=0; itree<fForest.size(); itree++) { " << std::endl
+       << "      delete fForest[itree]; " << std::endl
+       << "   }" << std::endl
+       << "}" << std::endl
+       << "   inline double " << className << "::GetMvaValue( const std::vector<double>& inputValues ) const" << std::endl
+       << "   {" << std::endl
+       << "      // classifier response value" << std::endl
+       << "      double retval = 0;" << std::endl << std::endl
+       << "      // classifier response, sanity check first" << std::endl
+       << "      if (!IsStatusClean()) {" << std::endl
+       << "         std::cout << \"Problem in class \\\"\" << fClassName << \"\\\": cannot return classifier response\"" << std::endl
+       << "                   << \" because status is dirty\" << std::endl;" << std::endl
+       << "         retval = 0;" << std::endl
+       << "      }" << std::endl
+       << "      else {" << std::endl
+       << "         retval = GetMvaValue__( inputValues );" << std::endl
+       << "      }" << std::endl << std::endl
+       << "      return retval;" << std::endl
+       << "   }" << std::endl;
+   return out.good() || Problem( "cannot write " + fileName );
+}
+
+//_______________________________________________________________________
+inline void BDTTrainer::RunTasks( size_t nTasks, const std::function<void( size_t )>& task )
+{
+   if (fThreads.empty() || nTasks <= 1) {
+      for (size_t i = 0; i < nTasks; i++) task( i );
+      return;
+   }
+   {
+      std::lock_guard<std::mutex> lock( fMutex );
+      fTask   = &task;
+      fNTasks = nTasks;
+      fNext   = 0;
+      fBusy   = fThreads.size();
+      fGeneration++;
+   }
+   fWake.notify_all();
+   for (size_t i = fNext++; i < nTasks; i = fNext++) task( i );
+   std::unique_lock<std::mutex> lock( fMutex );
+   fDone.wait( lock, [this]() { return fBusy == 0; } );
+}
+
+//_______________________________________________________________________
+inline void BDTTrainer::StartWorkers()
+{
+   fStop = false;
+   for (int iw = 1; iw < fNWorkers; iw++) fThreads.push_back( std::thread( &BDTTrainer::WorkerLoop, this, fGeneration ) );
+}
+
+//_______________________________________________________________________
+inline void BDTTrainer::StopWorkers()
+{
+   if (fThreads.empty()) return;
+   {
+      std::lock_guard<std::mutex> lock( fMutex );
+      fStop = true;
+   }
+   fWake.notify_all();
+   for (size_t iw = 0; iw < fThreads.size(); iw++) fThreads[iw].join();
+   fThreads.clear();
+}
+
+//_______________________________________________________________________
+inline void BDTTrainer::WorkerLoop( int generation )
+{
+   for (;;) {
+      const std::function<void( size_t )>* task;
+      size_t nTasks;
+      {
+         std::unique_lock<std::mutex> lock( fMutex );
+         fWake.wait( lock, [&]() { return fStop || fGeneration != generation; } );
+         if (fStop) return;
+         generation = fGeneration;
+         task       = fTask;
+         nTasks     = fNTasks;
+      }
+      for (size_t i = fNext++; i < nTasks; i = fNext++) (*task)( i );
+      std::lock_guard<std::mutex> lock( fMutex );
+      if (--fBusy == 0) fDone.notify_one();
+   }
+}
+
+#endif
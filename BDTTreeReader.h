@@ -0,0 +1,96 @@
+// Class: BDTTreeReader
+// Reads a list of branches of a TTree, whatever their type (Float_t, Int_t or
+// Double_t), into float columns, entry range by entry range. Only the listed
+// branches are enabled; an optional branch missing from the tree is read as
+// its default value.
+//
+// usage:
+//
+//     BDTTreeReader reader( tree, columns );
+//     if (!reader.IsStatusClean()) ...                   // a branch is missing
+//     reader.Read( first, last, buffers );               // buffers[ic][j-first]
+//
+
+#ifndef BDTTreeReader__def
+#define BDTTreeReader__def
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TLeaf.h"
+#include "TString.h"
+#include "TTree.h"
+
+class BDTTreeReader {
+
+ public:
+
+   BDTTreeReader( TTree* tree, const std::vector<std::string>& columns,
+                  const std::vector<bool>& optional = std::vector<bool>(),
+                  const std::vector<float>& defaults = std::vector<float>() );
+
+   // false if a (non optional) branch is missing
+   bool IsStatusClean() const { return fStatusIsClean; }
+
+   Long64_t GetEntries() const { return fTree->GetEntries(); }
+
+   // entries [first, last) of every column: columns[ic][j - first]
+   void Read( Long64_t first, Long64_t last, float* const* columns );
+
+ private:
+
+   TTree*                fTree;
+   bool                  fStatusIsClean;
+   std::vector<char>     fType;      // 'F', 'I', 'D', or 'X' (missing: default)
+   std::vector<float>    fDefault;
+   std::vector<Float_t>  fFloat;     // branch buffers, one per column and type
+   std::vector<Int_t>    fInt;
+   std::vector<Double_t> fDouble;
+};
+
+//_______________________________________________________________________
+inline BDTTreeReader::BDTTreeReader( TTree* tree, const std::vector<std::string>& columns,
+                                     const std::vector<bool>& optional, const std::vector<float>& defaults )
+   : fTree( tree ), fStatusIsClean( true ), fType( columns.size(), 'F' ), fDefault( columns.size(), 0 ),
+     fFloat( columns.size(), 0 ), fInt( columns.size(), 0 ), fDouble( columns.size(), 0 )
+{
+   fTree->SetBranchStatus( "*", 0 );
+   for (size_t ic = 0; ic < columns.size(); ic++) {
+      const char* name = columns[ic].c_str();
+      if (ic < defaults.size()) fDefault[ic] = defaults[ic];
+      TBranch* branch = fTree->GetBranch( name );
+      if (!branch) {
+         fType[ic] = 'X';
+         if (ic < optional.size() && optional[ic]) continue;
+         std::cout << "Problem in class \"BDTTreeReader\": no branch " << name
+                   << " in " << fTree->GetName() << std::endl;
+         fStatusIsClean = false;
+         continue;
+      }
+      fTree->SetBranchStatus( name, 1 );
+      TString leafType = branch->GetLeaf( name ) ? branch->GetLeaf( name )->GetTypeName() : "Float_t";
+      if      (leafType == "Int_t")    { fType[ic] = 'I'; fTree->SetBranchAddress( name, &fInt[ic] ); }
+      else if (leafType == "Double_t") { fType[ic] = 'D'; fTree->SetBranchAddress( name, &fDouble[ic] ); }
+      else                             { fType[ic] = 'F'; fTree->SetBranchAddress( name, &fFloat[ic] ); }
+   }
+}
+
+//_______________________________________________________________________
+inline void BDTTreeReader::Read( Long64_t first, Long64_t last, float* const* columns )
+{
+   const size_t ncol = fType.size();
+   for (Long64_t j = first; j < last; j++) {
+      fTree->GetEntry( j );
+      for (size_t ic = 0; ic < ncol; ic++) {
+         float value;
+         if      (fType[ic] == 'F') value = fFloat[ic];
+         else if (fType[ic] == 'I') value = fInt[ic];
+         else if (fType[ic] == 'D') value = fDouble[ic];
+         else                       value = fDefault[ic];
+         columns[ic][j - first] = value;
+      }
+   }
+}
+
+#endif